@@ -1,124 +1,68 @@
 #ifndef HEX_HPP
 #define HEX_HPP
 
+#include "hex_board.hpp"
+#include "hex_flood.hpp"
+#include "hex_zobrist.hpp"
+#include "hex_record.hpp"
+#include "hex_sampling.hpp"
+#include "hex_rng.hpp"
+#include "hex_model.hpp"
+#include "hex_book.hpp"
+
 #include <shark/Models/ConcatenatedModel.h>
 #include <string>
 #include <memory>
 #include <fstream>
+#include <limits>
 
 using namespace shark;
 
 namespace Hex {
-    static const unsigned BOARD_SIZE = 7;
-
-    enum TileState : unsigned {
-        Blue = 0,
-        Red = 1,
-        Empty = 2
-    };
-
-    class LineSegment {
-    public:
-        bool Connected_A = false;
-        bool Connected_B = false;
-        LineSegment (bool _connected_A, bool _connected_B) {
-            Connected_A = _connected_A;
-            Connected_B = _connected_B;
-        }
-
-        bool Merge(std::shared_ptr<LineSegment> other) {
-            Merge(other->Connected_A, other->Connected_B);
-        }
-
-        bool Merge(bool other_A, bool other_B) {
-            Connected_A |= other_A;
-            Connected_B |= other_B;
-            return Connected_A && Connected_B;
-        }
-    };
+    // a RealVector stores its elements consecutively, see ParameterSpan
+    template <>
+    struct IsDenseVector<RealVector> : std::true_type {};
 
+    // Compatibility view of a single cell for strategies that read the board as a matrix.
+    // The game itself is stored in a Board, see hex_board.hpp.
     class Tile {
-        std::shared_ptr<LineSegment> m_linesegment;
-        Tile* m_tile_ref;
     public:
         TileState tileState;
 
         Tile () {
             tileState = Empty;
-            m_linesegment = nullptr;
-            m_tile_ref = nullptr;
         }
 
         void reset() {
             tileState = Empty;
-            m_linesegment = nullptr;
-            m_tile_ref = nullptr;
-        }
-
-        // get's the line segment that a tile is potentially referencing
-        std::shared_ptr<LineSegment> GetLineSegment() {
-            if (m_linesegment != nullptr) {
-                return m_linesegment;
-            } else if (m_tile_ref != nullptr) {
-                return m_tile_ref->GetLineSegment();
-            } else {
-                return nullptr;
-            }
-        }
-
-        // Set the linesegment on a tile
-        void ReferLineSegment(Tile* newref) {
-            if (m_linesegment != nullptr) {
-                m_linesegment = nullptr;
-                m_tile_ref = newref;
-            } else if (m_tile_ref != nullptr) {
-                m_tile_ref->ReferLineSegment(newref);
-            }
-        }
-
-        bool OwnsLine() { return m_linesegment != nullptr; }
-
-        // Placces a tile on the gameboard. Is used by takeTurn.
-        bool PlaceTile(TileState newState, Tile* neighbours[6], int edge_id) {
-            tileState = newState;
-            bool tile_connected_A = (edge_id == -1);
-            bool tile_connected_B = (edge_id == 1);
-
-            bool foundNeighbour = false;
-            bool won = false;
-            std::shared_ptr<LineSegment> neighbourLineSegment = nullptr;
-            std::shared_ptr<LineSegment> myLineSegment = nullptr;
-            for (int i=0; i < 6; i++) {
-                if (neighbours[i] != nullptr && neighbours[i]->tileState == tileState) {
-                    myLineSegment = GetLineSegment();
-                    neighbourLineSegment = neighbours[i]->GetLineSegment();
-                    if (foundNeighbour && neighbourLineSegment != myLineSegment) {
-                        // Another neighbour, combine segments
-                        won |= neighbourLineSegment->Merge(myLineSegment);
-                        ReferLineSegment(neighbours[i]);
-                    }
-                    else if (!foundNeighbour) {
-                        // First neighbour, add to this segment
-                        foundNeighbour = true;
-                        won |= neighbourLineSegment->Merge(tile_connected_A, tile_connected_B);
-                        m_tile_ref = neighbours[i];
-                    }
-                }
-            }
-            if (!foundNeighbour) {
-                m_linesegment = std::shared_ptr<LineSegment>(new LineSegment(tile_connected_A, tile_connected_B));
-            }
-            return won;
         }
     };
 
     // The base-strategy for all strategies
+    template <unsigned N>
     class Strategy {
     public:
         virtual RealVector getMoveAction(blas::matrix<Tile>const& field) = 0;
+
+        // move preferences for the board as seen through a view, indexed like the view. By default the
+        // view is copied into a field for getMoveAction, strategies that read the view directly override it.
+        virtual RealVector getMoveAction(BoardView<N> const& view) {
+            blas::matrix<Tile> field(N, N);
+            for (unsigned i=0; i < N; i++) {
+                for (unsigned j=0; j < N; j++) {
+                    field(i,j).tileState = view(i,j);
+                }
+            }
+            return getMoveAction(field);
+        }
         virtual std::size_t numParameters() const = 0;
-        virtual void setParameters(RealVector const& parameters) = 0;
-        virtual ConcatenatedModel<RealVector> GetMoveModel() = 0;
+        // copies the parameters into the model, a RealVector converts to a ParameterSpan
+        virtual void setParameters(ParameterSpan parameters) = 0;
+
+        // the network of the strategy, owned by it
+        virtual ConcatenatedModel<RealVector>& GetMoveModel() {
+            throw std::logic_error("the strategy has no model");
+        }
 
         // reverses a vector (for use in rotateField)
         blas::vector<Hex::Tile> reverseVector(blas::vector<Hex::Tile> vec) {
@@ -131,8 +75,8 @@ namespace Hex {
 
         // rotates field
         shark::blas::matrix<Hex::Tile> rotateField(shark::blas::matrix<Hex::Tile> field, bool clockwise) {
-            shark::blas::matrix<Hex::Tile> fieldCopy(Hex::BOARD_SIZE, Hex::BOARD_SIZE);
-            for (int i=0; i < Hex::BOARD_SIZE; i++) {
+            shark::blas::matrix<Hex::Tile> fieldCopy(N, N);
+            for (int i=0; i < N; i++) {
                 if (clockwise) {
                     row(fieldCopy, i) = reverseVector(column(field, i));
                 } else {
@@ -145,35 +89,104 @@ namespace Hex {
 
         // takes a 1D index of a matrix and converts it to the corresponding 1D index of the same matrix, but rotated clockwise, undoing the counterclockwise rotation
         int flipToOriginalRotatedIndex(int i) {
-            return i % Hex::BOARD_SIZE * Hex::BOARD_SIZE + Hex::BOARD_SIZE - ceil(i/Hex::BOARD_SIZE) - 1;
+            return RotationTable<N>::get().toBoard[i];
         }
 
+        // loads a binary model (see hex_model.hpp) or a text archive written by Shark, copying the
+        // parameters into the model of the strategy. The inference weights of a binary model are
+        // handed to modelLoaded, mapped.
         void loadStrategy(std::string model_path) {
-            std::ifstream ifs(model_path);
-            boost::archive::polymorphic_text_iarchive ia(ifs);
-            GetMoveModel().read(ia);
-            ifs.close();
+            std::shared_ptr<float const> inference_weights;
+            if (isModelFile(model_path)) {
+                ModelFileReader file(model_path);
+                if (file.shapes() != layerShapes()) {
+                    throw std::runtime_error("the layers of model file " + model_path + " do not match the strategy");
+                }
+                RealVector parameters(file.numParameters());
+                file.copyParameters(parameters);
+                GetMoveModel().setParameterVector(parameters);
+                inference_weights = file.inferenceWeights();
+            } else {
+                std::ifstream ifs(model_path);
+                boost::archive::polymorphic_text_iarchive ia(ifs);
+                GetMoveModel().read(ia);
+                ifs.close();
+            }
+            modelLoaded(inference_weights);
         }
 
+        // Called after loadStrategy replaced the weights of the model. inference_weights are those of
+        // the model in the layout of MLPInference::layout() if the model file stores them, else null.
+        virtual void modelLoaded(std::shared_ptr<float const> const& inference_weights) {}
+
+        // the layers of the model, strategies that describe them are saved as binary models
+        virtual std::vector<LayerShape> layerShapes() const { return {}; }
+
         void saveStrategy(std::string model_path) {
             std::ostringstream name;
             name << model_path << ".model" ;
+            std::vector<LayerShape> shapes = layerShapes();
+            if (!shapes.empty()) {
+                writeModelFile(name.str(), shapes, GetMoveModel().parameterVector());
+                return;
+            }
             std::ofstream ofs(name.str());
             boost::archive::polymorphic_text_oarchive oa(ofs);
             GetMoveModel().write(oa);
             ofs.close();
         }
 
-        // 0=base, 1=network-CMA, 2=network-TD , 3=human strategy, 4=random strategy
+        // Book moves are played before anything is evaluated, by Game::takeStrategyTurn and by the
+        // getChosenMove of the strategies that have one. The book is not owned, nullptr turns it off.
+        void setOpeningBook(OpeningBook<N> const* book) { m_book = book; }
+        OpeningBook<N> const* openingBook() const { return m_book; }
+
+        // the book move of the player to move and its value, false if the book does not have the position
+        bool bookMove(Board<N> const& board, unsigned player, std::pair<double, int>& chosen) const {
+            return m_book && m_book->find(board, player, chosen);
+        }
+
+        // 0=base, 1=network-CMA, 2=network-TD , 3=human strategy, 4=random strategy, 5=MCTS over a TD network,
+        // 6=alpha-beta over a TD network, 7=policy and value network, 8=convolutional TD network
         virtual int type () {return 0;}
+
+    protected:
+        OpeningBook<N> const* m_book = nullptr;
+    };
+
+    // How a Game finds out that a move won: by keeping the union-find of the Board up to date,
+    // or by flood filling the group of the new stone on the bit-sets (see hex_flood.hpp).
+    enum class WinDetection {
+        UnionFind,
+        FloodFill
     };
 
     // A class for the Hex-simulator
+    template <unsigned N>
     class Game {
 
-	    blas::matrix<Tile> m_gameboard;
+        Board<N> m_board;
         unsigned m_activePlayer = 0;
         unsigned m_playerWon = -1;
+        WinDetection m_win_detection = WinDetection::UnionFind;
+
+        // undo information of every move made since the last reset, see makeMove/unmakeMove
+        typename Board<N>::Undo m_undo_stack[N*N];
+        unsigned m_num_moves = 0;
+
+        // dense list of the empty cells and the position of every cell in it. A taken cell is swapped
+        // behind the end of the list and keeps its old position, which is how unmakeMove puts it back.
+        uint8_t m_empty_cells[N*N];
+        uint8_t m_empty_pos[N*N];
+        unsigned m_num_empty = 0;
+
+        // Zobrist hashes of the position as each player sees it when it is their move (the red player
+        // sees the board rotated counterclockwise), as is and rotated by 180 degrees. See hash().
+        uint64_t m_view_hash[2][2] = {{0, 0}, {0, 0}};
+
+        // finished games are appended here if set, see setRecorder. Copies of the game share it.
+        GameRecordWriter* m_recorder = nullptr;
+        int8_t m_strategy_types[2] = {0, 0};
 
 
         const std::string m_red_color = "\033[1;31m";
@@ -190,103 +203,111 @@ namespace Hex {
         unsigned int m_next_rank;
 
 
-        // returns a vector containing the feasible moves of the board.
-        IntVector m_feasible_move_actions(blas::matrix<Tile> const& field) const {
-            IntVector feasible_moves((BOARD_SIZE*BOARD_SIZE), 1);
-            for (int i=0; i<BOARD_SIZE; i++) {
-                for (int j=0; j<BOARD_SIZE; j++) {
-                    if (field(i, j).tileState != Empty) {
-                        feasible_moves(BOARD_SIZE * i + j) = 0;
-                    }
-                }
+        // returns a vector containing the feasible moves of the board, optionally in the
+        // counterclockwise rotated view used for the red player (see Strategy::rotateField).
+        IntVector m_feasible_move_actions(bool rotated) const {
+            IntVector feasible_moves((N*N), 0);
+            for (unsigned k=0; k < m_num_empty; k++) {
+                unsigned idx = m_empty_cells[k];
+                feasible_moves(rotated ? RotationTable<N>::get().toView[idx] : idx) = 1;
             }
             return feasible_moves;
         }
-        // Converts the feasible-moves to a vector of probabilities(used for sampling actions.)
-        RealVector m_feasible_probabilies(RealVector probs, IntVector const& feasible_moves) const {
-            for (std::size_t i=0; i != probs.size(); i++) {
-                if (!feasible_moves(i)) {
-                    probs(i) = -std::numeric_limits<double>::max();
-                }
-            }
-            probs = exp(probs - max(probs));
-            probs /= sum(probs);
-            return probs;
-        }
-
-        // Randomly sample an action from the feasible moves.
-        unsigned int m_sample_move_action(RealVector const& action_prob)const{
-            double u = random::uni(random::globalRng(), 0.0, 1.0);
-		    double cumulant = 0.0;
-            unsigned int max = 0;
-            for (std::size_t i=0; i < action_prob.size(); i++) {
-                cumulant += action_prob(i);
-                if (cumulant > u) {
-                    return i;
-                }
+        // Samples a move (a cell of the board) from move preferences indexed like the view, with a softmax
+        // over the empty cells only.
+        unsigned m_sample_move_action(RealVector const& preferences, BoardView<N> const& view) const {
+            RotationTable<N> const& rotation = RotationTable<N>::get();
+            uint8_t const* toView = (view.rotated() ? rotation.toView : rotation.identity);
+            double legal[N*N];
+            for (unsigned k=0; k < m_num_empty; k++) {
+                legal[k] = preferences(toView[m_empty_cells[k]]);
             }
-            return action_prob.size() - 1;
+            return m_empty_cells[sampleSoftmax(legal, m_num_empty, currentRng())];
         }
 
         // Takes a specific action.
         bool m_take_move_action(unsigned move_action) {
-            unsigned x = move_action % BOARD_SIZE;
-            unsigned y = move_action / BOARD_SIZE;
-            std::pair<unsigned,unsigned> pos (y, x);
-            //if (m_activePlayer == 1) {
-            //    std::pair<unsigned,unsigned> pos (x, y);
-            //}
-            return m_place_tile(pos);
+            if (move_action >= N*N || !m_board.empty(move_action)) {
+                throw std::invalid_argument("double place!");
+            }
+            m_remove_empty(move_action);
+            m_toggle_hash(move_action, m_activePlayer);
+            if (m_win_detection == WinDetection::FloodFill) {
+                m_board.placeUnlinked(move_action, (TileState)m_activePlayer, m_undo_stack[m_num_moves++]);
+                return Hex::FloodFill<N>::connectedThrough(m_board.stones(m_activePlayer), m_activePlayer, move_action);
+            }
+            return m_board.place(move_action, (TileState)m_activePlayer, m_undo_stack[m_num_moves++]);
         }
 
-        void m_next_player() {
-            m_activePlayer = (m_activePlayer + 1) % 2;
-
+        // empties the board and forgets the moves, everything of reset but the starting player
+        void m_clear() {
+            m_board.clear();
+            m_playerWon = -1;
+            turns_taken = 0;
+            m_num_moves = 0;
+            m_reset_empty();
+            m_view_hash[0][0] = m_view_hash[0][1] = m_view_hash[1][0] = m_view_hash[1][1] = 0;
+            m_strategy_types[Blue] = m_strategy_types[Red] = 0;
         }
 
-        void m_initializeboard() {
-            for (int i=0; i < BOARD_SIZE; i++) {
-                for (int j=0; j < BOARD_SIZE; j++) {
-                    m_gameboard(i,j) = Tile();
-                }
+        void m_reset_empty() {
+            m_num_empty = N*N;
+            for (unsigned i=0; i < N*N; i++) {
+                m_empty_cells[i] = i;
+                m_empty_pos[i] = i;
             }
         }
 
-
-        Tile* m_get_neighbour(int x, int y) {
-            if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE || m_gameboard(x,y).tileState == Empty) {
-                return nullptr;
+        void m_remove_empty(unsigned cell) {
+            unsigned pos = m_empty_pos[cell];
+            unsigned last = m_empty_cells[--m_num_empty];
+            m_empty_cells[pos] = last;
+            m_empty_pos[last] = pos;
+            m_empty_cells[m_num_empty] = cell;
+            m_empty_pos[cell] = pos;
+        }
+
+        // reverts the latest m_remove_empty
+        void m_restore_empty() {
+            unsigned cell = m_empty_cells[m_num_empty];
+            unsigned pos = m_empty_pos[cell];
+            unsigned moved = m_empty_cells[pos];
+            m_empty_cells[pos] = cell;
+            m_empty_cells[m_num_empty] = moved;
+            m_empty_pos[moved] = m_num_empty;
+            m_num_empty++;
+        }
+
+        // adds or removes a stone of the given color in all view hashes
+        void m_toggle_hash(unsigned cell, unsigned color) {
+            ZobristKeys<N> const& zobrist = ZobristKeys<N>::get();
+            for (unsigned player = 0; player < 2; player++) {
+                unsigned view = (player == Red ? RotationTable<N>::get().toView[cell] : cell);
+                unsigned side = (color == player ? 0 : 1);
+                m_view_hash[player][0] ^= zobrist.keys[side][view];
+                m_view_hash[player][1] ^= zobrist.keys[side][N*N - 1 - view];
             }
-            return &m_gameboard(x,y);
         }
 
-        bool m_place_tile(std::pair<unsigned, unsigned> pos) {
-            if (m_gameboard(pos.first, pos.second).tileState != Empty) {
-                throw std::invalid_argument("double place!");
-            }
-            Tile* neighbours[6] = {
-                // Upper neigbours
-                m_get_neighbour(pos.first,   pos.second-1),
-                m_get_neighbour(pos.first+1, pos.second-1),
-                // Horizontal neighbours
-                m_get_neighbour(pos.first-1, pos.second),
-                m_get_neighbour(pos.first+1, pos.second),
-                // Lower neighbours
-                m_get_neighbour(pos.first-1, pos.second+1),
-                m_get_neighbour(pos.first,   pos.second+1)
-            };
-            int edge_id = 0;
-            switch (m_activePlayer) {
-                case 0:
-                    if      (pos.second == 0) { edge_id = -1; }
-                    else if (pos.second == BOARD_SIZE-1) { edge_id = 1; }
-                    break;
-                case 1:
-                    if      (pos.first == 0) { edge_id = -1; }
-                    else if (pos.first == BOARD_SIZE-1) { edge_id = 1; }
-                    break;
+        // appends the finished game to the recorder, the moves are on the undo stack
+        void m_record_game() {
+            uint8_t moves[N*N];
+            for (unsigned k=0; k < m_num_moves; k++) {
+                moves[k] = m_undo_stack[k].cell;
             }
-            return m_gameboard(pos.first, pos.second).PlaceTile((TileState)m_activePlayer, neighbours, edge_id);
+            GameRecordHeader header;
+            header.boardSize = N;
+            header.firstPlayer = m_undo_stack[0].color;
+            header.winner = m_playerWon;
+            header.numMoves = m_num_moves;
+            header.strategies[Blue] = m_strategy_types[Blue];
+            header.strategies[Red] = m_strategy_types[Red];
+            m_recorder->write(header, moves);
+        }
+
+        void m_next_player() {
+            m_activePlayer = (m_activePlayer + 1) % 2;
+
         }
 
         std::pair<unsigned,unsigned> m_alphnum2num(std::string position) {
@@ -298,7 +319,7 @@ namespace Hex {
             for (int i = 0; i < start_spaces; i++) {
                 resStr += " ";
             }
-            for (char i = 65; i < 65+BOARD_SIZE; i++) {
+            for (char i = 65; i < 65+N; i++) {
                 resStr += m_red_color + i + m_reset_color + " ";
             }
             resStr += '\n';
@@ -306,100 +327,144 @@ namespace Hex {
         }
 
     public:
-        typedef Hex::Strategy Strategy;
+        typedef Hex::Strategy<N> Strategy;
+
+        static const unsigned BOARD_SIZE = N;
 
         unsigned turns_taken = 0;
 
-        Game() : m_gameboard(BOARD_SIZE, BOARD_SIZE) {
-            m_initializeboard();
+        Game() {
+            m_reset_empty();
+        }
+
+        Board<N> const& getBoard() const {
+            return m_board;
         }
 
-	    blas::matrix<Tile> getGameBoard() {
-            return m_gameboard;
+        // builds the matrix of tiles read by the strategies
+	    blas::matrix<Tile> getGameBoard() const {
+            blas::matrix<Tile> field(N, N);
+            for (unsigned i=0; i < N; i++) {
+                for (unsigned j=0; j < N; j++) {
+                    field(i,j).tileState = m_board.at(i * N + j);
+                }
+            }
+            return field;
         }
 
-        RealVector getFlatGameBoard() {
-            RealVector gb(Hex::BOARD_SIZE*Hex::BOARD_SIZE, 0.0);
-            for (int i=0; i<Hex::BOARD_SIZE; i++) {
-                for (int j=0; j<Hex::BOARD_SIZE; j++) {
-                    if (m_gameboard(i,j).tileState != Empty) {
-                        gb(BOARD_SIZE * i + j) = 1.0;
-                    }
+        RealVector getFlatGameBoard() const {
+            RealVector gb(N*N, 0.0);
+            for (unsigned i=0; i < N*N; i++) {
+                if (!m_board.empty(i)) {
+                    gb(i) = 1.0;
                 }
             }
             return gb;
         }
 
-        RealVector getFeasibleMoves(blas::matrix<Tile> field) {
-            return m_feasible_move_actions(field);
+        // feasible moves of the board, rotated counterclockwise if seen from the red player's view
+        RealVector getFeasibleMoves(bool rotated) const {
+            return m_feasible_move_actions(rotated);
+        }
+
+        // the empty cells in no particular order, emptyCell(k) for k < numEmptyCells()
+        unsigned numEmptyCells() const { return m_num_empty; }
+        unsigned emptyCell(unsigned k) const { return m_empty_cells[k]; }
+
+        // uniformly sampled empty cell
+        unsigned randomEmptyCell() const {
+            return m_empty_cells[random::discrete(currentRng(), std::size_t(0), std::size_t(m_num_empty - 1))];
         }
 
         void reset() {
-            // reset board
-            for (std::size_t i = 0; i < BOARD_SIZE; i++) {
-                for (std::size_t j = 0; j < BOARD_SIZE; j++) {
-                    m_gameboard(i,j).reset();
-                }
-            }
+            m_clear();
             //m_activePlayer = 0;
              //random starting player
-            if (random::coinToss(random::globalRng())) {
+            if (random::coinToss(currentRng())) {
                 m_activePlayer = 0;
             } else {
                 m_activePlayer = 1;
             }
-            m_playerWon = -1;
-            turns_taken = 0;
         }
 
+        // same as above with a given starting player, the random number generator is not drawn from
+        void reset(unsigned firstPlayer) {
+            m_clear();
+            m_activePlayer = firstPlayer;
+        }
+
+        // rotates the board by 180 degrees. The moves so far are replayed on the rotated cells, so
+        // the empty cells, the view hashes and the undo stack of unmakeMove follow the rotation.
         void FlipBoard() {
-            int ri = BOARD_SIZE-1;
-            int rj = BOARD_SIZE-1;
-            for (int i=0; i < BOARD_SIZE; i++) {
-                rj = BOARD_SIZE-1;
-                for (int j=0; j < BOARD_SIZE; j++) {
-                    Tile tmptile = m_gameboard(i,j);
-
-                    m_gameboard(i,j) = m_gameboard(ri, rj);
-                    m_gameboard(ri,rj) = tmptile;
-                    rj--;
+            uint8_t cells[N*N];
+            uint8_t colors[N*N];
+            unsigned num_moves = m_num_moves;
+            for (unsigned k=0; k < num_moves; k++) {
+                cells[k] = N*N - 1 - m_undo_stack[k].cell;
+                colors[k] = m_undo_stack[k].color;
+            }
+            m_board.clear();
+            m_num_moves = 0;
+            m_reset_empty();
+            m_view_hash[0][0] = m_view_hash[0][1] = m_view_hash[1][0] = m_view_hash[1][1] = 0;
+            for (unsigned k=0; k < num_moves; k++) {
+                m_remove_empty(cells[k]);
+                m_toggle_hash(cells[k], colors[k]);
+                if (m_win_detection == WinDetection::FloodFill) {
+                    m_board.placeUnlinked(cells[k], (TileState)colors[k], m_undo_stack[m_num_moves++]);
+                } else {
+                    m_board.place(cells[k], (TileState)colors[k], m_undo_stack[m_num_moves++]);
                 }
-                ri--;
             }
         }
 
-        unsigned ActivePlayer() {return m_activePlayer;}
+        unsigned ActivePlayer() const {return m_activePlayer;}
+
+        // Every game finished through takeTurn is appended to the recorder (nullptr turns this off).
+        // Strategy ids are taken from takeStrategyTurn; callers that choose moves themselves can
+        // set them with setStrategyType.
+        void setRecorder(GameRecordWriter* recorder) { m_recorder = recorder; }
+        void setStrategyType(unsigned player, int type) { m_strategy_types[player] = type; }
+
+        // Selects how wins are detected. Switch between games, the union-find of the board is
+        // not maintained while flood fill is in use.
+        void setWinDetection(WinDetection win_detection) { m_win_detection = win_detection; }
+        WinDetection getWinDetection() const { return m_win_detection; }
 
         bool takeStrategyTurn(std::vector<Strategy*> const& strategies) {
             // get player information
             auto strategy = strategies[m_activePlayer];
+            m_strategy_types[m_activePlayer] = strategy->type();
+            return takeTurn(chooseStrategyMove(*strategy));
+        }
 
-            blas::matrix<Tile> fieldCopy;
-            RealVector feasibleMoves;
-            // find all feasible moves
-            if (m_activePlayer == Red && strategy->type() != 3) {
-                fieldCopy = strategy->rotateField(m_gameboard, false );
-                feasibleMoves = m_feasible_move_actions( fieldCopy );
-            } else {
-                fieldCopy = m_gameboard;
-                feasibleMoves = m_feasible_move_actions( m_gameboard );
+        // The move of a strategy for the active player, as takeStrategyTurn plays it: the book move,
+        // or one sampled from the preferences of the strategy for the empty cells.
+        unsigned chooseStrategyMove(Strategy& strategy) const {
+            // a random strategy has uniform preferences, so sample the empty cells directly
+            if (strategy.type() == 4) {
+                return randomEmptyCell();
+            }
+
+            std::pair<double, int> book_move;
+            if (strategy.bookMove(m_board, m_activePlayer, book_move)) {
+                return book_move.second;
             }
-            // get action preferences from player and transform into probabilities
-            RealVector moveProbs = m_feasible_probabilies(strategy->getMoveAction(fieldCopy) , feasibleMoves);
-            // sample an action and take turn
-            double moveAction = (m_activePlayer == Red && strategy->type() != 3
-                                ? strategy->flipToOriginalRotatedIndex(m_sample_move_action(moveProbs))
-                                : m_sample_move_action(moveProbs));
 
-            return takeTurn(moveAction);
+            // the red player sees the board rotated, except for humans
+            bool rotated = (m_activePlayer == Red && strategy.type() != 3);
+            BoardView<N> view(m_board, rotated);
+            // get action preferences from player and sample an action
+            return m_sample_move_action(strategy.getMoveAction(view), view);
         }
 
         bool takeTurn(double moveAction) {
-            turns_taken++;
-
             bool won;
             try {
-                won = m_take_move_action(moveAction);
+                won = makeMove(moveAction);
+                if (won && m_recorder) {
+                    m_record_game();
+                }
             } catch (std::invalid_argument& e) {
                 // std::cerr << "exception: " << e.what() << std::endl;
                 // std::cout << feasibleMoves << std::endl;
@@ -407,42 +472,71 @@ namespace Hex {
                 // std::cout << moveProbs << std::endl;
                 throw(e);
             }
+            return !won;
+        }
+
+        // Plays a move for the active player and pushes it on the undo stack. Returns true if the move won the game.
+        bool makeMove(unsigned moveAction) {
+            bool won = m_take_move_action(moveAction);
+            turns_taken++;
             if (won) {
                 m_playerWon = m_activePlayer;
             }
             m_next_player();
-            return !won;
+            return won;
+        }
+
+        // Takes back the last move, restoring stones, connectivity and the player to move exactly.
+        void unmakeMove() {
+            m_board.unplace(m_undo_stack[--m_num_moves]);
+            m_toggle_hash(m_undo_stack[m_num_moves].cell, m_undo_stack[m_num_moves].color);
+            m_restore_empty();
+            turns_taken--;
+            m_playerWon = -1;
+            m_next_player();
+        }
+
+        // Hash of the position as the player to move sees it, the input of the TD network. It is the
+        // same for positions that only differ by the 180 degree symmetry of FlipBoard, or by which
+        // color is to move when that player's view of the board is the same.
+        uint64_t hash() const {
+            return std::min(m_view_hash[m_activePlayer][0], m_view_hash[m_activePlayer][1]);
         }
 
         int getRank(std::size_t player)const {
             return player == m_playerWon ? 0 : 1;
         }
 
+        // whether a player has won, then there are no moves to search
+        bool finished() const {
+            return m_playerWon != unsigned(-1);
+        }
+
         std::string asciiState() {
             std::string resStr("");
             resStr += m_printletters(1);
-            for (int i=0; i < BOARD_SIZE; i++) {
+            for (int i=0; i < N; i++) {
                 for (int ii=0; ii < i; ii++) {
                     if (ii == 8) { continue; }
                     resStr += " ";
                 }
                 resStr += m_blue_color + std::to_string(i+1) + m_reset_color;
-                for (int j=0; j < BOARD_SIZE; j++) {
-                    resStr += " " + m_hexes[m_gameboard(i, j).tileState];
+                for (int j=0; j < N; j++) {
+                    resStr += " " + m_hexes[m_board.at(i * N + j)];
                 }
                 resStr +=  " " + m_blue_color + std::to_string(i+1) + m_reset_color;
                 resStr += '\n';
             }
-            resStr += m_printletters(BOARD_SIZE + 2);
+            resStr += m_printletters(N + 2);
             return resStr;
         }
 
         std::string asciiStatePython() {
             std::string resStr("");
             resStr += "__BOARD_BEGIN__\n";
-            for (int i=0; i < BOARD_SIZE; i++) {
-                for (int j=0; j < BOARD_SIZE; j++) {
-                    resStr += std::to_string(m_gameboard(i,j).tileState);
+            for (int i=0; i < N; i++) {
+                for (int j=0; j < N; j++) {
+                    resStr += std::to_string(m_board.at(i * N + j));
                 }
                 resStr += '\n';
             }
@@ -451,6 +545,71 @@ namespace Hex {
         }
 
     };
+
+    // A game at the position a strategy is shown, cell(v) being the state of index v of player's
+    // view (rotated for red), with player to move. The stones are replayed alternately, for
+    // strategies that search from the position with makeMove and unmakeMove.
+    template <unsigned N, class Cell>
+    Game<N> replayPosition(Cell&& cell, unsigned player) {
+        RotationTable<N> const& rotation = RotationTable<N>::get();
+        uint8_t const* toBoard = (player == Red ? rotation.toBoard : rotation.identity);
+        unsigned stones[2][N*N];
+        unsigned counts[2] = {0, 0};
+        for (unsigned v = 0; v < N*N; v++) {
+            TileState state = cell(v);
+            if (state != Empty) {
+                stones[state][counts[state]++] = toBoard[v];
+            }
+        }
+        // starting with whoever leaves player to move
+        unsigned total = counts[Blue] + counts[Red];
+        unsigned first = (total % 2 == 0 ? player : 1 - player);
+        if (counts[first] != (total + 1) / 2 || counts[1 - first] != total / 2) {
+            throw std::invalid_argument("replayPosition: the stones on the board cannot be reached by alternating moves");
+        }
+        Game<N> game;
+        game.reset(first);
+        for (unsigned k = 0; k < total; k++) {
+            game.makeMove(stones[k % 2 == 0 ? first : 1 - first][k / 2]);
+        }
+        return game;
+    }
+
+    // A strategy that picks a single cell from a Game: both getMoveAction overloads replay the
+    // position they are shown and give all the preference to the chosen cell, like a human's choice.
+    template <unsigned N>
+    class ReplayStrategy : public Strategy<N> {
+    protected:
+        unsigned m_color = Blue;
+
+        // the cell chosen for the active player of the game, which is left as it was
+        virtual unsigned chooseReplayMove(Game<N>& game) = 0;
+
+        RealVector m_preferences(Game<N>& game) {
+            uint8_t const* toView = (game.ActivePlayer() == Red ? RotationTable<N>::get().toView
+                                                                : RotationTable<N>::get().identity);
+            RealVector preferences(N * N, -std::numeric_limits<double>::max());
+            preferences(toView[chooseReplayMove(game)]) = 1.0;
+            return preferences;
+        }
+
+    public:
+        void setColor(unsigned color) {
+            m_color = color;
+        }
+
+        // the player to move is the color set by setColor
+        RealVector getMoveAction(blas::matrix<Tile> const& field) override {
+            Game<N> game = replayPosition<N>([&](unsigned v) { return field(v / N, v % N).tileState; }, m_color);
+            return m_preferences(game);
+        }
+
+        // Game::takeStrategyTurn shows red the rotated board
+        RealVector getMoveAction(BoardView<N> const& view) override {
+            Game<N> game = replayPosition<N>([&](unsigned v) { return view.at(v); }, view.rotated() ? Red : Blue);
+            return m_preferences(game);
+        }
+    };
 }
 
 #endif
\ No newline at end of file
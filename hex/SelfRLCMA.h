@@ -6,9 +6,18 @@
 #include <shark/Core/Threading/Algorithms.h>
 #include <boost/math/distributions/chi_squared.hpp>
 #include <shark/Algorithms/DirectSearch/LMCMA.h>
+#include "hex_rng.hpp"
 namespace shark {
 
-
+/// \brief Objective of self play, a search point playing against another one.
+///
+/// eval takes the two search points concatenated, evalPair reads them where they are, which is what
+/// SelfRLCMA uses for objectives that have it.
+class SelfPlayObjectiveFunction : public SingleObjectiveFunction {
+public:
+	/// \brief Result of the first search point against the second.
+	virtual double evalPair(SearchPointType const& first, SearchPointType const& second) const = 0;
+};
 
 
 class SelfRLCMA : public AbstractSingleObjectiveOptimizer<RealVector >{
@@ -52,6 +61,7 @@ public:
 		m_lambda = lambda;
 
 		m_firstIter = true;
+		m_generation = 0;
 
 		//variables for mean
 		m_mean = blas::repeat(0.0, m_numberOfVariables);
@@ -81,7 +91,13 @@ public:
 
 	/// \brief Executes one iteration of the algorithm.
 	void step(ObjectiveFunctionType const& function){
-		std::vector<IndividualType> offspring = generateOffspring();
+		std::vector<IndividualType>& offspring = generateOffspring();
+		SelfPlayObjectiveFunction const* selfPlay = dynamic_cast<SelfPlayObjectiveFunction const*>(&function);
+		auto play = [&](IndividualType const& first, IndividualType const& second){
+			if(selfPlay)
+				return selfPlay->evalPair(first.searchPoint(), second.searchPoint());
+			return function(first.searchPoint() | second.searchPoint());
+		};
 
 		struct Eval{
 			std::size_t first;
@@ -94,8 +110,15 @@ public:
 			auto& individual1 = offspring[eval.first];
 			auto& individual2 = offspring[eval.second];
 			auto& individual3 = offspring[eval.third];
-			eval.result1 = function(individual1.searchPoint() | individual2.searchPoint());
-			eval.result2 = function(individual1.searchPoint() | individual3.searchPoint());
+			//the games of every evaluation get their own random stream, independent of the thread running them
+			{
+				Hex::RngScope rng(Hex::rngStream(m_generation, eval.first, 0, 0));
+				eval.result1 = play(individual1, individual2);
+			}
+			{
+				Hex::RngScope rng(Hex::rngStream(m_generation, eval.first, 1, 0));
+				eval.result2 = play(individual1, individual3);
+			}
 			return eval;
 		};
 
@@ -157,6 +180,7 @@ public:
 		m_rate = 1.0/(1.0+1.0/(m_ztest-1.0));
 
 		updatePopulation(offspring);
+		m_generation++;
 	}
 
 
@@ -169,7 +193,7 @@ public:
 	}
 
 	RealVector generatePolicy()const{
-		return m_mean + remora::normal(random::globalRng(), m_numberOfVariables, 0.0, sqr(m_sigma), remora::cpu_tag());
+		return m_mean + remora::normal(Hex::currentRng(), m_numberOfVariables, 0.0, sqr(m_sigma), remora::cpu_tag());
 	}
 
 	RealVector const& mean()const{
@@ -184,7 +208,9 @@ protected:
 		auto sampler = [&](std::size_t i){
 			RealVector& z = m_offspring[i].chromosome();
 			RealVector& x = m_offspring[i].searchPoint();
-			noalias(z) = remora::normal(random::globalRng(), m_numberOfVariables, 0.0, 1.0, remora::cpu_tag());
+			//game ids 0 and 1 are the evaluations of the offspring, 2 is its mutation
+			Hex::Philox rng = Hex::rngStream(m_generation, i, 2, 0);
+			noalias(z) = remora::normal(rng, m_numberOfVariables, 0.0, 1.0, remora::cpu_tag());
 			noalias(x) = m_mean + m_sigma * z;
 		};
 
@@ -233,6 +259,7 @@ protected:
 
 private:
 	mutable std::vector<IndividualType > m_offspring;
+	std::size_t m_generation; ///< Number of steps taken, part of the key of every random stream of a step.
 	std::size_t m_numberOfVariables; ///< Stores the dimensionality of the search space.
 	std::size_t m_lambda; ///< The size of the offspring population, needs to be larger than mu.
 
@@ -0,0 +1,91 @@
+#ifndef HEX_ACCUMULATOR_HPP
+#define HEX_ACCUMULATOR_HPP
+
+#include "hex_board.hpp"
+#include "hex_mlp.hpp"
+
+#include <vector>
+
+namespace Hex {
+
+    /***********************\
+     *  Board accumulator  *
+    \***********************/
+    // First layer pre-activations of a network (see MLPInference) for the board as seen by each
+    // player: own stones 1, the opponent's -1, red seeing the board rotated counterclockwise like in
+    // Game::takeStrategyTurn. The accumulator remembers the stones it was built for and follows any
+    // board by adding the weights of the stones that were placed and subtracting those that were
+    // taken back, so across turns of a game it costs two weight rows per stone instead of a full
+    // first layer product per evaluation.
+    template <unsigned N>
+    class BoardAccumulator {
+        static const unsigned CELLS = Board<N>::CELLS;
+        static const unsigned WORDS = Board<N>::WORDS;
+
+        uint64_t m_stones[2][WORDS];
+        std::vector<float> m_accumulators[2];     // [player]
+
+        // input of the cell in the view of the player
+        static unsigned m_input(unsigned player, unsigned idx) {
+            return player == Red ? RotationTable<N>::get().toView[idx] : idx;
+        }
+
+    public:
+        BoardAccumulator() {
+            for (unsigned w = 0; w < WORDS; w++) {
+                m_stones[Blue][w] = m_stones[Red][w] = 0;
+            }
+        }
+
+        // the accumulators of the empty board. Needed whenever the weights of the network change.
+        void reset(MLPInference const& network) {
+            for (unsigned player = 0; player < 2; player++) {
+                m_accumulators[player].resize(network.accumulatorSize());
+                network.initAccumulator(m_accumulators[player].data());
+            }
+            for (unsigned w = 0; w < WORDS; w++) {
+                m_stones[Blue][w] = m_stones[Red][w] = 0;
+            }
+        }
+
+        // brings the accumulators up to date with the board
+        void update(MLPInference const& network, Board<N> const& board) {
+            if (m_accumulators[0].empty()) {
+                reset(network);
+            }
+            for (unsigned color = 0; color < 2; color++) {
+                uint64_t const* stones = board.stones(color);
+                for (unsigned w = 0; w < WORDS; w++) {
+                    uint64_t changed = stones[w] ^ m_stones[color][w];
+                    while (changed) {
+                        unsigned idx = w * 64 + __builtin_ctzll(changed);
+                        changed &= changed - 1;
+                        // +1 for a placed stone of the player, -1 for the opponent, reversed if taken back
+                        float placed = ((stones[w] >> (idx % 64)) & 1) ? 1.0f : -1.0f;
+                        for (unsigned player = 0; player < 2; player++) {
+                            float sign = (player == color ? placed : -placed);
+                            network.accumulate(m_accumulators[player].data(), m_input(player, idx), sign);
+                        }
+                    }
+                    m_stones[color][w] = stones[w];
+                }
+            }
+        }
+
+        float const* accumulator(unsigned player) const {
+            return m_accumulators[player].data();
+        }
+
+        // the network output for the board the accumulators are up to date with, from the view of player
+        float const* eval(MLPInference const& network, unsigned player) const {
+            return network.evalAccumulated(accumulator(player));
+        }
+
+        // the network output from the view of player for the board with an extra stone of color at idx
+        float const* evalAfterstate(MLPInference const& network, unsigned player, unsigned color, unsigned idx) const {
+            return network.evalAccumulated(accumulator(player), m_input(player, idx), player == color ? 1.0f : -1.0f);
+        }
+    };
+}
+
+#endif
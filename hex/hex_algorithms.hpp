@@ -12,54 +12,73 @@ namespace Hex {
 /********************\
  *  Base Algorithm  *
 \********************/
-template <class StrategyType>
+template <unsigned N, class StrategyType>
 class HexMLAlgorithm {
 protected:
-    Game m_game;
+    Game<N> m_game;
     StrategyType m_strategy;
 public:
     HexMLAlgorithm() {}
 
-    Game GetGame() { return m_game; }
-    StrategyType GetStrategy() { return m_strategy; }
+    // the game and the strategy the algorithm trains, copy them to play games of your own
+    Game<N>& GetGame() { return m_game; }
+    StrategyType& GetStrategy() { return m_strategy; }
     virtual void EpisodeStep(unsigned episode) = 0;
+
+    // records the games of the algorithm and of every copy of its game, see Game::setRecorder
+    void setRecorder(GameRecordWriter* recorder) { m_game.setRecorder(recorder); }
 };
 
 
 /*******************\
  *  TD Algorithm   *
 \*******************/
-class TDAlgorithm : public HexMLAlgorithm<TDNetworkStrategy> {
+// trains a value network, TDNetworkStrategy or ConvNetworkStrategy
+template <unsigned N, class StrategyType = TDNetworkStrategy<N>>
+class TDAlgorithm : public HexMLAlgorithm<N, StrategyType> {
 private:
+    using HexMLAlgorithm<N, StrategyType>::m_game;
+    using HexMLAlgorithm<N, StrategyType>::m_strategy;
+
     RealVector m_weights;
     double m_learning_rate = 0.1;
+    // size of an encoded state
+    std::size_t m_inputs;
+
+    // buffers of EpisodeStep, kept across episodes so an episode does not allocate: the encoded state
+    // of every ply of a game (at most N*N), the states of the last game as a batch, the values of the
+    // network for it, the td-errors and the derivative
+    RealMatrix m_states;
+    RealMatrix m_stateBatch;
+    RealMatrix m_valueBatch;
+    RealMatrix m_tdErrors;
+    RealVector m_derivative;
+    boost::shared_ptr<State> m_state;
 public:
-    TDAlgorithm() : HexMLAlgorithm() {
-        m_weights = blas::normal(random::globalRng(), m_strategy.numParameters(), 0.0, 1.0/m_strategy.numParameters(), blas::cpu_tag());
+    TDAlgorithm() {
+        m_strategy.enableCache();
+        m_weights = blas::normal(currentRng(), m_strategy.numParameters(), 0.0, 1.0/m_strategy.numParameters(), blas::cpu_tag());
+        m_inputs = m_strategy.GetMoveModel().inputShape().numElements();
+        m_states.resize(N*N, m_inputs);
+        m_state = m_strategy.createState();
     }
 
-    Game GetGame() { return m_game; }
-    TDNetworkStrategy GetStrategy() { return m_strategy; }
-
     // Take one step in the algorithm (run episode/game and calculate new weights)
     void EpisodeStep(unsigned episode) override {
         m_game.reset();
+        m_game.setStrategyType(Blue, m_strategy.type());
+        m_game.setStrategyType(Red, m_strategy.type());
         bool won = false;
         m_strategy.setParameters(m_weights);
 
-        // save states, values and rewards for computing derivatives
-        std::vector<RealVector> states;
-        RealVector rewards;
-        RealVector values;
-        RealVector nextValues;
+        // states are saved for computing derivatives, the values follow from one pass over the states.
+        // The reward is 1 for the move that won and 0 for all others.
+        std::size_t num_states = 0;
 
         // game turns elapsed
         int step_i = 0;
 
-        // variable for storing input to the neural network
-        RealVector input((Hex::BOARD_SIZE*Hex::BOARD_SIZE), 0.0);
-
-        // Play game and record states, values and rewards
+        // Play game and record states
         while (!won) {
             unsigned playerWithTurn = m_game.ActivePlayer();
 
@@ -68,36 +87,15 @@ public:
 
             // take action
             try {
-                if (chosen_move.second < 0 || chosen_move.second >= Hex::BOARD_SIZE*Hex::BOARD_SIZE) {
+                if (chosen_move.second < 0 || chosen_move.second >= N*N) {
                     std::cout << "Chosen move for player 1 " << chosen_move.second << " out of range." << std::endl;
                     std::cout << std::endl;
                     exit(1);
                 } else {
-                    // create input
-                    blas::matrix<Tile> fieldCopy;
-                    if (playerWithTurn == Red) {
-                        fieldCopy = m_strategy.rotateField(m_game.getGameBoard(), false);
-                    } else {
-                        fieldCopy = m_game.getGameBoard();
-                    }
-                    m_strategy.createInput(fieldCopy, playerWithTurn, input);
-                    // push state, encoded like the state used in the neural network
-                    states.push_back(input);
-                    // push value
-                    values.push_back( m_strategy.evaluateNetwork(input) );
+                    // save the state, encoded like the state used in the neural network
+                    m_strategy.createInput(m_game.getBoard(), playerWithTurn, row(m_states, num_states++));
 
                     won = !m_game.takeTurn(chosen_move.second);
-
-                    // push 1 as reward if game is over, else 0
-                    if (!won) {
-                        rewards.push_back(0.0);
-                    } else {
-                        rewards.push_back(1.0);
-                    }
-                    // push previous value as states' next value
-                    if (step_i > 0) {
-                        nextValues.push_back(1 - values[step_i]);
-                    }
                 }
             } catch (std::invalid_argument& e) {
                 std::cout << std::endl;
@@ -105,38 +103,134 @@ public:
             }
             step_i++;
         }
-        // push last "next" value (for t+1)
-        nextValues.push_back(1.0);
-
-        // Type of state and value points
-        RealVector statePoint((Hex::BOARD_SIZE*Hex::BOARD_SIZE));
-        RealVector valuePoint(1);
-
-        // batch of states
-        Batch<RealVector>::type stateBatch = Batch<RealVector>::createBatch(statePoint, states.size());
-        // batch of values/outputs/predictions
-        Batch<RealVector>::type valueBatch = Batch<RealVector>::createBatch(valuePoint, states.size());
-
-        // fill batches
-        for (int i=0; i < states.size(); i++) {
-            getBatchElement(stateBatch, i) = states[i];
-            getBatchElement(valueBatch, i)(0) = nextValues(i);
+        // batch of the states of the game, its capacity is kept between the episodes
+        if (m_stateBatch.size1() != num_states) {
+            m_stateBatch.resize(num_states, m_inputs);
+        }
+        for (std::size_t i=0; i < num_states; i++) {
+            row(m_stateBatch, i) = row(m_states, i);
         }
-        //std::cout << "R: " << rewards << " V: " << values << " NV: " << nextValues << std::endl;
 
-        // computes td-errors
-        RealMatrix tdErrors(states.size(), m_strategy.GetMoveModel().outputShape().numElements());
-        column(tdErrors, 0) = (rewards + nextValues - values);
+        ConcatenatedModel<RealVector>& network = m_strategy.GetMoveModel();
+        // compute the values of all states and an internal state of the model, used for computing derivatives
+        network.eval(m_stateBatch, m_valueBatch, *m_state);
 
-        boost::shared_ptr<State> state = m_strategy.createState();
-        // compute an internal state of the model, used for computing derivatives
-        m_strategy.GetMoveModel().eval(stateBatch, valueBatch, *state);
+        // td-error of a state: reward + next value - value, where the next value is the value of the
+        // following state from the opponent's view, 1 after the last state
+        if (m_tdErrors.size1() != num_states) {
+            m_tdErrors.resize(num_states, network.outputShape().numElements());
+        }
+        for (std::size_t i=0; i < num_states; i++) {
+            double reward = (i + 1 == num_states ? 1.0 : 0.0);
+            double nextValue = (i + 1 < num_states ? 1 - m_valueBatch(i + 1, 0) : 1.0);
+            m_tdErrors(i, 0) = reward + nextValue - m_valueBatch(i, 0);
+        }
 
-        RealVector derivative;
-        m_strategy.GetMoveModel().weightedParameterDerivative(stateBatch, valueBatch, tdErrors, *state, derivative);
+        network.weightedParameterDerivative(m_stateBatch, m_valueBatch, m_tdErrors, *m_state, m_derivative);
 
         // update weights
-        m_weights += m_learning_rate*derivative;
+        noalias(m_weights) += m_learning_rate*m_derivative;
+    }
+};
+
+
+/*********************************\
+ *  Policy and Value Algorithm   *
+\*********************************/
+// Self-play with DualHeadStrategy, sampling every move from the policy head, one forward pass per
+// ply. The value head learns by TD like TDAlgorithm, from the states of the player with the turn.
+// The policy head follows the td-error of each state as its advantage (actor-critic): the log
+// probability of the move that was played, among the empty cells, is raised by it.
+template <unsigned N>
+class DualHeadAlgorithm : public HexMLAlgorithm<N, DualHeadStrategy<N>> {
+private:
+    using HexMLAlgorithm<N, DualHeadStrategy<N>>::m_game;
+    using HexMLAlgorithm<N, DualHeadStrategy<N>>::m_strategy;
+
+    RealVector m_weights;
+    double m_learning_rate = 0.1;
+    // of the policy gradient, relative to the gradient of the value
+    double m_policy_weight = 0.1;
+
+    // buffers of EpisodeStep like those of TDAlgorithm, with the index of the view of every move
+    RealMatrix m_states;
+    unsigned m_actions[N*N];
+    RealMatrix m_stateBatch;
+    RealMatrix m_outputBatch;
+    RealMatrix m_tdErrors;
+    RealVector m_derivative;
+    boost::shared_ptr<State> m_state;
+public:
+    DualHeadAlgorithm() {
+        m_weights = blas::normal(currentRng(), m_strategy.numParameters(), 0.0, 1.0/m_strategy.numParameters(), blas::cpu_tag());
+        m_strategy.setParameters(m_weights);
+        m_states.resize(N*N, N*N);
+        m_state = m_strategy.createState();
+    }
+
+    // Take one step in the algorithm (run episode/game and calculate new weights)
+    void EpisodeStep(unsigned episode) override {
+        m_game.reset();
+        m_game.setStrategyType(Blue, m_strategy.type());
+        m_game.setStrategyType(Red, m_strategy.type());
+        m_strategy.setParameters(m_weights);
+
+        // Play game and record states and moves. The reward is 1 for the move that won and 0 for all others.
+        std::size_t num_states = 0;
+        bool won = false;
+        while (!won) {
+            unsigned playerWithTurn = m_game.ActivePlayer();
+            std::pair<double, int> chosen_move = m_strategy.getChosenMove(m_game, true);
+
+            m_strategy.createInput(m_game.getBoard(), playerWithTurn, row(m_states, num_states));
+            uint8_t const* toView = (playerWithTurn == Red ? RotationTable<N>::get().toView : RotationTable<N>::get().identity);
+            m_actions[num_states++] = toView[chosen_move.second];
+
+            won = !m_game.takeTurn(chosen_move.second);
+        }
+        if (m_stateBatch.size1() != num_states) {
+            m_stateBatch.resize(num_states, N*N);
+        }
+        for (std::size_t i=0; i < num_states; i++) {
+            row(m_stateBatch, i) = row(m_states, i);
+        }
+
+        ConcatenatedModel<RealVector>& network = m_strategy.GetMoveModel();
+        network.eval(m_stateBatch, m_outputBatch, *m_state);
+
+        // the weights of the outputs in the derivative: the td-error times the slope of the logistic
+        // for the value logit, the td-error times the gradient of the log softmax for the move logits
+        if (m_tdErrors.size1() != num_states) {
+            m_tdErrors.resize(num_states, N*N + 1);
+        }
+        m_tdErrors.clear();
+        for (std::size_t i=0; i < num_states; i++) {
+            double value = DualHeadStrategy<N>::value(m_outputBatch(i, N*N));
+            double reward = (i + 1 == num_states ? 1.0 : 0.0);
+            double nextValue = (i + 1 < num_states ? 1 - DualHeadStrategy<N>::value(m_outputBatch(i + 1, N*N)) : 1.0);
+            double tdError = reward + nextValue - value;
+            m_tdErrors(i, N*N) = tdError * value * (1 - value);
+
+            double max_logit = m_outputBatch(i, m_actions[i]);
+            for (unsigned v=0; v < N*N; v++) {
+                if (m_stateBatch(i, v) == 0.0) { max_logit = std::max(max_logit, m_outputBatch(i, v)); }
+            }
+            double sum = 0;
+            for (unsigned v=0; v < N*N; v++) {
+                if (m_stateBatch(i, v) == 0.0) { sum += std::exp(m_outputBatch(i, v) - max_logit); }
+            }
+            for (unsigned v=0; v < N*N; v++) {
+                if (m_stateBatch(i, v) == 0.0) {
+                    double probability = std::exp(m_outputBatch(i, v) - max_logit) / sum;
+                    m_tdErrors(i, v) = m_policy_weight * tdError * ((v == m_actions[i] ? 1.0 : 0.0) - probability);
+                }
+            }
+        }
+
+        network.weightedParameterDerivative(m_stateBatch, m_outputBatch, m_tdErrors, *m_state, m_derivative);
+
+        // update weights
+        noalias(m_weights) += m_learning_rate*m_derivative;
     }
 };
 
@@ -144,13 +238,14 @@ public:
  *  SelfPlayTwoPlayer  *
 \***********************/
 template<class Game, class Strategy>
-class SelfPlayTwoPlayer : public SingleObjectiveFunction {
+class SelfPlayTwoPlayer : public SelfPlayObjectiveFunction {
 private:
 	Game m_game;
 	Strategy m_baseStrategy;
+	std::size_t m_gamesPerEvaluation;
 public:
-	SelfPlayTwoPlayer(Game const& game, Strategy const& strategy)
-	: m_game(game), m_baseStrategy(strategy){
+	SelfPlayTwoPlayer(Game const& game, Strategy const& strategy, std::size_t gamesPerEvaluation = 1)
+	: m_game(game), m_baseStrategy(strategy), m_gamesPerEvaluation(gamesPerEvaluation){
 		m_features |= CAN_PROPOSE_STARTING_POINT;
 		m_features |= IS_NOISY;
 	}
@@ -164,40 +259,79 @@ public:
 	}
 
 	SearchPointType proposeStartingPoint() const {
-		return blas::normal(random::globalRng(), numberOfVariables(), 0.0, 1.0/numberOfVariables(), shark::blas::cpu_tag());
+		return blas::normal(currentRng(), numberOfVariables(), 0.0, 1.0/numberOfVariables(), shark::blas::cpu_tag());
 	}
 
+	// the two search points concatenated
 	double eval(SearchPointType const& x) const {
 		SIZE_CHECK(x.size() == 2*numberOfVariables());
-		m_evaluationCounter++;
+		ParameterSpan both(x);
+		return m_play(both.subspan(0, numberOfVariables()), both.subspan(numberOfVariables(), numberOfVariables()));
+	}
 
-		auto x0 = subrange(x,0, numberOfVariables());
-		auto x1 = subrange(x, numberOfVariables(), x.size());
+	double evalPair(SearchPointType const& first, SearchPointType const& second) const override {
+		SIZE_CHECK(first.size() == numberOfVariables() && second.size() == numberOfVariables());
+		return m_play(ParameterSpan(first), ParameterSpan(second));
+	}
+
+private:
+	// the strategies play from the search points in place, the games and buffers of a thread are
+	// reused by its next evaluation
+	double m_play(ParameterSpan x0, ParameterSpan x1) const {
+		m_evaluationCounter++;
 
 		thread_local Strategy strategy0;
 		thread_local Strategy strategy1;
-		thread_local Game game = m_game;
-
-		strategy0.setParameters(x0);
-		strategy1.setParameters(x1);
 
-		//simulate
-		game.reset();
-        while(game.takeStrategyTurn({&strategy0, &strategy1})){ }
-        // return reward of player 1
-        return game.getRank(0);
+		strategy0.setPlayParameters(x0);
+		strategy1.setPlayParameters(x1);
+		Strategy* strategies[2] = {&strategy0, &strategy1};
+
+		//simulate all games in lockstep, each ply evaluates both networks once for all their games
+		thread_local GameBatch<Game::BOARD_SIZE> batch(0, 0);
+		thread_local std::vector<unsigned> moves;
+		thread_local std::vector<std::size_t> slots[2];
+		thread_local RealMatrix responses;
+		batch.reset(m_gamesPerEvaluation, m_gamesPerEvaluation);
+		moves.resize(batch.size());
+		if (responses.size1() < batch.size()) {
+			responses.resize(batch.size(), Game::BOARD_SIZE * Game::BOARD_SIZE);
+		}
+		while (!batch.done()) {
+			slots[Blue].clear();
+			slots[Red].clear();
+			for (std::size_t g = 0; g < batch.size(); g++) {
+				if (batch.running(g)) {
+					slots[batch.activePlayer(g)].push_back(g);
+				}
+			}
+			for (unsigned player = 0; player < 2; player++) {
+				if (slots[player].empty()) { continue; }
+				strategies[player]->getMoveActions(batch, slots[player], responses);
+				for (std::size_t k = 0; k < slots[player].size(); k++) {
+					moves[slots[player][k]] = batch.sampleMove(slots[player][k], row(responses, k), player == Red);
+				}
+			}
+			batch.step(moves.data());
+		}
+        // return reward of player 1, the rank of blue averaged over the games
+        return double(batch.wins(Red)) / batch.gamesFinished();
 	}
 };
 
 /**********************\
  *  CSA-ES Algorithm  *
 \**********************/
-class CSAAlgorithm : public HexMLAlgorithm<CSANetworkStrategy> {
+template <unsigned N>
+class CSAAlgorithm : public HexMLAlgorithm<N, CSANetworkStrategy<N>> {
 private:
-    SelfPlayTwoPlayer<Game, CSANetworkStrategy> m_objective;
+    using HexMLAlgorithm<N, CSANetworkStrategy<N>>::m_game;
+    using HexMLAlgorithm<N, CSANetworkStrategy<N>>::m_strategy;
+
+    SelfPlayTwoPlayer<Game<N>, CSANetworkStrategy<N>> m_objective;
     SelfRLCMA m_csa;
 public:
-    CSAAlgorithm() : HexMLAlgorithm(), m_objective(m_game, m_strategy) {
+    CSAAlgorithm() : m_objective(m_game, m_strategy) {
         m_strategy.setColor(Blue);
 
         std::size_t d = m_objective.numberOfVariables();
@@ -210,7 +344,7 @@ public:
 		m_csa.step(m_objective);
     }
 
-    SelfRLCMA GetCSA() {
+    SelfRLCMA const& GetCSA() const {
         return m_csa;
     }
 };
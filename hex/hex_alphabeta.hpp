@@ -0,0 +1,360 @@
+#ifndef HEX_ALPHABETA_HPP
+#define HEX_ALPHABETA_HPP
+
+#include "Hex.hpp"
+#include "hex_strategies.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+namespace Hex {
+
+    /****************\
+     *  Alpha-beta  *
+    \****************/
+    // Search settings of AlphaBetaStrategy. Iterative deepening stops at max_depth or, if
+    // milliseconds is not 0, when the time per move is up; only completed iterations count.
+    struct AlphaBetaOptions {
+        unsigned max_depth = 4;             // plies
+        unsigned milliseconds = 0;          // time per move
+        unsigned log2_entries = 20;         // transposition table entries, 16 bytes each
+    };
+
+    // what the last search of an AlphaBetaStrategy did
+    struct AlphaBetaStats {
+        std::size_t nodes = 0;              // positions searched or valued
+        std::size_t probes = 0;             // transposition table lookups
+        std::size_t hits = 0;               // lookups that ended the search of a position
+        unsigned depth = 0;                 // deepest completed iteration
+        bool out_of_time = false;           // whether the time per move cut off an iteration
+        double seconds = 0;
+    };
+
+    // Transposition table of fixed size, indexed by a hash of the position. An entry is replaced by
+    // a search of the same or a greater depth, or by any search once it is from an earlier move.
+    // Positions that Game::hash() takes as the same can be symmetric to each other, so the stored
+    // move is only a hint for move ordering.
+    class TranspositionTable {
+    public:
+        enum : uint8_t { Exact, Lower, Upper };
+
+        struct Entry {
+            uint64_t key;
+            float value;
+            uint8_t depth;
+            uint8_t bound;
+            uint8_t move;
+            uint8_t generation;
+        };
+
+    private:
+        std::unique_ptr<Entry[]> m_entries;
+        uint64_t m_mask = 0;
+        uint8_t m_generation = 0;
+
+    public:
+        void resize(unsigned log2_entries) {
+            m_entries.reset(new Entry[std::size_t(1) << log2_entries]);
+            m_mask = (uint64_t(1) << log2_entries) - 1;
+            clear();
+        }
+
+        std::size_t size() const { return m_entries ? m_mask + 1 : 0; }
+
+        void clear() {
+            for (uint64_t i = 0; i <= m_mask; i++) {
+                m_entries[i] = Entry{0, 0.0f, 0, Exact, 0, 0};
+            }
+            m_generation = 1;
+        }
+
+        // a new search, the entries of earlier ones may be replaced by anything
+        void age() {
+            if (++m_generation == 0) { m_generation = 1; }
+        }
+
+        Entry const* probe(uint64_t key) const {
+            Entry const& entry = m_entries[key & m_mask];
+            return (entry.generation != 0 && entry.key == key) ? &entry : nullptr;
+        }
+
+        void store(uint64_t key, double value, unsigned depth, uint8_t bound, unsigned move) {
+            Entry& entry = m_entries[key & m_mask];
+            if (entry.generation == m_generation && entry.key != key && depth < entry.depth) {
+                return;
+            }
+            entry = Entry{key, float(value), uint8_t(depth), bound, uint8_t(move), m_generation};
+        }
+    };
+
+    // Negamax with alpha-beta pruning and iterative deepening, on the value network of a TD model.
+    // Values are the chance of the player to move to win, so the value of a move is one minus the
+    // value of the position after it. The moves of a position are ordered by their one-ply network
+    // values, from one accumulator update like TDNetworkStrategy::getMoveValues, after the move of
+    // the transposition table; at the last ply those values are the leaves, valued only until one
+    // reaches beta. Wins score above 1, the sooner the higher. The search plays and takes back the
+    // moves on the game it is given and keeps its move lists on the stack, so nothing is allocated
+    // per position.
+    //
+    // The model is loaded and saved like a TD model and evaluated by the float32 or int8 inference
+    // engine; precision Double evaluates in float32.
+    template <unsigned N>
+    class AlphaBetaStrategy : public ReplayStrategy<N> {
+        TDNetworkStrategy<N> m_evaluator;
+        BoardAccumulator<N> m_accumulator;
+        TranspositionTable m_table;
+        AlphaBetaOptions m_options;
+        AlphaBetaStats m_stats;
+
+        std::chrono::steady_clock::time_point m_deadline;
+        bool m_timed = false;       // whether the iteration in progress may run out of time
+        std::size_t m_calls = 0;    // of m_negamax, the clock is read every 256
+        bool m_aborted = false;
+
+        static constexpr double WIN = 1.0;
+        static constexpr double BOUND = 2.0;    // beyond every value, wins included
+
+        static double m_win(unsigned depth) {
+            return WIN + 0.001 * depth;
+        }
+
+        void m_evaluatorChanged() {
+            m_accumulator.reset(m_evaluator.inference());
+            if (m_table.size()) { m_table.clear(); }
+        }
+
+        // The value of the position for the player to move, searched depth plies deep, and its
+        // best move. Within (alpha, beta) it is exact, otherwise it bounds the value. The root is
+        // always searched, as its move has to be one of this position and not of a symmetric one.
+        double m_negamax(Game<N>& game, unsigned depth, double alpha, double beta, unsigned& best_move,
+                         bool root = false) {
+            m_stats.nodes++;
+            if (m_timed && (++m_calls & 255) == 0 && std::chrono::steady_clock::now() >= m_deadline) {
+                m_aborted = true;
+            }
+            if (m_aborted) {
+                return 0.0;
+            }
+
+            // Game::hash() is the same for the two players when their views of the board are, which
+            // only the network takes as the same position, so the player to move is part of the key
+            uint64_t key = game.hash() ^ (game.ActivePlayer() == Red ? 0x9E3779B97F4A7C15ULL : 0);
+            int hint = -1;
+            m_stats.probes++;
+            if (TranspositionTable::Entry const* entry = m_table.probe(key)) {
+                if (game.getBoard().empty(entry->move)) {
+                    hint = entry->move;
+                }
+                if (!root && entry->depth >= depth) {
+                    double value = entry->value;
+                    if (entry->bound == TranspositionTable::Exact
+                        || (entry->bound == TranspositionTable::Lower && value >= beta)
+                        || (entry->bound == TranspositionTable::Upper && value <= alpha)) {
+                        m_stats.hits++;
+                        best_move = (hint >= 0 ? hint : game.emptyCell(0));
+                        return value;
+                    }
+                }
+            }
+
+            unsigned num_empty = game.numEmptyCells();
+            // getChosenMove does not search finished games, and a full board always has a winner
+            if (num_empty == 0) {
+                throw std::logic_error("AlphaBetaStrategy: an unfinished position without moves");
+            }
+            unsigned moves[N*N];
+            double values[N*N];
+            for (unsigned k = 0; k < num_empty; k++) {
+                moves[k] = game.emptyCell(k);
+                bool won = game.makeMove(moves[k]);
+                game.unmakeMove();
+                if (won) {
+                    best_move = moves[k];
+                    m_table.store(key, m_win(depth), depth, TranspositionTable::Exact, best_move);
+                    return m_win(depth);
+                }
+            }
+            // one-ply values, the afterstates valued by the opponent
+            unsigned player = game.ActivePlayer();
+            MLPInference const& inference = m_evaluator.inference();
+            m_accumulator.update(inference, game.getBoard());
+
+            if (depth <= 1) {
+                // the values are the leaves, valued until one fails high, the hint of the table first
+                for (unsigned k = 1; hint >= 0 && k < num_empty; k++) {
+                    if (int(moves[k]) == hint) { std::swap(moves[0], moves[k]); }
+                }
+                double best = -BOUND;
+                for (unsigned k = 0; k < num_empty && best < beta; k++) {
+                    double value = 1 - m_accumulator.evalAfterstate(inference, 1 - player, player, moves[k])[0];
+                    m_stats.nodes++;
+                    if (value > best) {
+                        best = value;
+                        best_move = moves[k];
+                    }
+                }
+                m_table.store(key, best, 1, best >= beta ? TranspositionTable::Lower : TranspositionTable::Exact, best_move);
+                return best;
+            }
+
+            for (unsigned k = 0; k < num_empty; k++) {
+                values[k] = 1 - m_accumulator.evalAfterstate(inference, 1 - player, player, moves[k])[0];
+            }
+            m_stats.nodes += num_empty;
+
+            // best first, the hint of the table before everything
+            for (unsigned k = 1; k < num_empty; k++) {
+                unsigned move = moves[k];
+                double value = values[k];
+                double key_value = (int(move) == hint ? BOUND : value);
+                unsigned j = k;
+                for (; j > 0 && (int(moves[j - 1]) == hint ? BOUND : values[j - 1]) < key_value; j--) {
+                    moves[j] = moves[j - 1];
+                    values[j] = values[j - 1];
+                }
+                moves[j] = move;
+                values[j] = value;
+            }
+
+            double original_alpha = alpha;
+            double best = -BOUND;
+            best_move = moves[0];
+            for (unsigned k = 0; k < num_empty; k++) {
+                unsigned reply;
+                game.makeMove(moves[k]);
+                double value = 1 - m_negamax(game, depth - 1, 1 - beta, 1 - alpha, reply);
+                game.unmakeMove();
+                if (m_aborted) {
+                    return 0.0;
+                }
+                if (value > best) {
+                    best = value;
+                    best_move = moves[k];
+                }
+                if (best > alpha) {
+                    alpha = best;
+                }
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+            uint8_t bound = (best <= original_alpha ? TranspositionTable::Upper
+                             : best >= beta ? TranspositionTable::Lower : TranspositionTable::Exact);
+            m_table.store(key, best, depth, bound, best_move);
+            return best;
+        }
+
+        // getMoveAction plays the searched move
+        unsigned chooseReplayMove(Game<N>& game) override {
+            return getChosenMove(game).second;
+        }
+
+    public:
+        void setOptions(AlphaBetaOptions const& options) {
+            if (options.max_depth == 0 || options.max_depth > 255) {
+                throw std::invalid_argument("AlphaBetaStrategy: the search depth must be from 1 to 255");
+            }
+            if (options.log2_entries != m_options.log2_entries) {
+                m_table = TranspositionTable();
+            }
+            m_options = options;
+        }
+
+        AlphaBetaOptions const& options() const { return m_options; }
+
+        AlphaBetaStats const& lastSearch() const { return m_stats; }
+
+        // forgets the searches so far; the table is otherwise allocated by the first search
+        void clearTable() {
+            if (m_table.size() == 0) {
+                m_table.resize(m_options.log2_entries);
+            } else {
+                m_table.clear();
+            }
+        }
+
+        TDNetworkStrategy<N> const& evaluator() const { return m_evaluator; }
+
+        void setPrecision(Precision precision) {
+            m_evaluator.setPrecision(precision);
+            m_evaluatorChanged();
+        }
+
+        Precision precision() const {
+            return m_evaluator.precision();
+        }
+
+        // Searches the position of the game for its active player, one ply deeper per iteration,
+        // and returns the best move of the deepest completed iteration with its value. The game is
+        // left as it was and must not be finished.
+        std::pair<double, int> getChosenMove(Game<N>& game) {
+            if (game.finished()) {
+                throw std::invalid_argument("AlphaBetaStrategy: the game is finished, there is no move to search");
+            }
+            std::pair<double, int> book_move;
+            if (this->bookMove(game.getBoard(), game.ActivePlayer(), book_move)) {
+                return book_move;
+            }
+            auto start_time = std::chrono::steady_clock::now();
+            if (m_table.size() == 0) {
+                m_table.resize(m_options.log2_entries);
+            }
+            m_table.age();
+            m_stats = AlphaBetaStats();
+            m_deadline = start_time + std::chrono::milliseconds(m_options.milliseconds);
+            m_aborted = false;
+
+            std::pair<double, int> chosen(0.0, -1);
+            for (unsigned depth = 1; depth <= m_options.max_depth; depth++) {
+                // the first iteration always completes, so there is a move
+                m_timed = (m_options.milliseconds != 0 && depth > 1);
+                unsigned move;
+                double value = m_negamax(game, depth, -BOUND, BOUND, move, true);
+                if (m_aborted) {
+                    m_stats.out_of_time = true;
+                    break;
+                }
+                chosen = std::pair<double, int>(value, move);
+                m_stats.depth = depth;
+                // decided, deeper searches cannot change the outcome
+                if (value > WIN || value < 1 - WIN || depth >= game.numEmptyCells()) {
+                    break;
+                }
+            }
+            m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            return chosen;
+        }
+
+        std::size_t numParameters() const override {
+            return m_evaluator.numParameters();
+        }
+
+        void setParameters(ParameterSpan parameters) override {
+            m_evaluator.setParameters(parameters);
+            m_evaluatorChanged();
+        }
+
+        ConcatenatedModel<RealVector>& GetMoveModel() override {
+            return m_evaluator.GetMoveModel();
+        }
+
+        void modelLoaded(std::shared_ptr<float const> const& inference_weights) override {
+            m_evaluator.modelLoaded(inference_weights);
+            m_evaluatorChanged();
+        }
+
+        std::vector<LayerShape> layerShapes() const override {
+            return m_evaluator.layerShapes();
+        }
+
+        int type() override {
+            return 6;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef HEX_BATCH_HPP
+#define HEX_BATCH_HPP
+
+#include "Hex.hpp"
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace shark;
+
+namespace Hex {
+
+    /****************\
+     *  Game Batch  *
+    \****************/
+    // Plays many games in lockstep, one ply of every running game per step. The games are stored as a
+    // structure of arrays: every stone word, union-find node and empty-list slot is one contiguous row
+    // with an entry per game, so resets and per-ply bookkeeping are flat loops over the games. Finished
+    // games are retired and their slot is refilled with a fresh game until all games have been started.
+    template <unsigned N>
+    class GameBatch {
+        static const unsigned CELLS = Board<N>::CELLS;
+        static const unsigned WORDS = Board<N>::WORDS;
+        static const unsigned NODES = Board<N>::NODES;
+
+        std::size_t m_size;
+        std::size_t m_total_games;
+        std::size_t m_games_started = 0;
+        std::size_t m_games_finished = 0;
+        std::size_t m_wins[2] = {0, 0};
+
+        std::vector<uint64_t> m_stones;         // [color][word][game]
+        std::vector<uint8_t> m_parent;          // [node][game]
+        std::vector<uint8_t> m_rank;            // [node][game]
+        std::vector<uint8_t> m_empty_cells;     // [k][game], dense list of the empty cells
+        std::vector<uint8_t> m_empty_pos;       // [cell][game], position of the cell in the list
+        std::vector<uint8_t> m_num_empty;       // [game]
+        std::vector<uint8_t> m_active_player;   // [game]
+        std::vector<uint8_t> m_running;         // [game]
+
+        // slot and winner of the games that ended in the last step
+        std::vector<std::pair<std::size_t, unsigned>> m_finished;
+
+        uint64_t& m_word(unsigned color, unsigned w, std::size_t g) {
+            return m_stones[(color * WORDS + w) * m_size + g];
+        }
+        uint64_t m_word(unsigned color, unsigned w, std::size_t g) const {
+            return m_stones[(color * WORDS + w) * m_size + g];
+        }
+
+        unsigned m_find(std::size_t g, unsigned node) const {
+            while (m_parent[node * m_size + g] != node) {
+                node = m_parent[node * m_size + g];
+            }
+            return node;
+        }
+
+        // union by rank, like Board
+        void m_union(std::size_t g, unsigned a, unsigned b) {
+            a = m_find(g, a);
+            b = m_find(g, b);
+            if (a == b) { return; }
+            if (m_rank[a * m_size + g] < m_rank[b * m_size + g]) { std::swap(a, b); }
+            m_parent[b * m_size + g] = a;
+            if (m_rank[a * m_size + g] == m_rank[b * m_size + g]) { m_rank[a * m_size + g]++; }
+        }
+
+        void m_start_game(std::size_t g) {
+            for (unsigned w = 0; w < 2 * WORDS; w++) {
+                m_stones[w * m_size + g] = 0;
+            }
+            for (unsigned i = 0; i < NODES; i++) {
+                m_parent[i * m_size + g] = i;
+                m_rank[i * m_size + g] = 0;
+            }
+            for (unsigned i = 0; i < CELLS; i++) {
+                m_empty_cells[i * m_size + g] = i;
+                m_empty_pos[i * m_size + g] = i;
+            }
+            m_num_empty[g] = CELLS;
+            // random starting player, like Game::reset
+            m_active_player[g] = random::coinToss(currentRng()) ? Blue : Red;
+            m_running[g] = 1;
+            m_games_started++;
+        }
+
+        void m_remove_empty(std::size_t g, unsigned cell) {
+            unsigned pos = m_empty_pos[cell * m_size + g];
+            unsigned last = m_empty_cells[--m_num_empty[g] * m_size + g];
+            m_empty_cells[pos * m_size + g] = last;
+            m_empty_pos[last * m_size + g] = pos;
+        }
+
+        // places a stone for the active player of game g, returns true if it won the game
+        bool m_place(std::size_t g, unsigned idx) {
+            unsigned color = m_active_player[g];
+            m_word(color, idx / 64, g) |= uint64_t(1) << (idx % 64);
+            m_remove_empty(g, idx);
+
+            NeighbourTable<N> const& table = Board<N>::neighbourTable();
+            unsigned edges = table.edges[idx] >> (2 * color);
+            if (edges & 1) { m_union(g, idx, CELLS + 2 * color); }
+            if (edges & 2) { m_union(g, idx, CELLS + 2 * color + 1); }
+            for (unsigned k = 0; k < 6; k++) {
+                unsigned nb = table.cells[idx][k];
+                if (has(g, color, nb)) {
+                    m_union(g, idx, nb);
+                }
+            }
+            return m_find(g, CELLS + 2 * color) == m_find(g, CELLS + 2 * color + 1);
+        }
+
+    public:
+        // a batch of size parallel slots that plays total_games games in all
+        GameBatch(std::size_t size, std::size_t total_games) {
+            reset(size, total_games);
+        }
+
+        // starts over like a new batch, keeping the memory of the old one
+        void reset(std::size_t size, std::size_t total_games) {
+            m_size = size;
+            m_total_games = total_games;
+            m_games_started = m_games_finished = 0;
+            m_wins[Blue] = m_wins[Red] = 0;
+            m_stones.resize(2 * WORDS * size);
+            m_parent.resize(NODES * size);
+            m_rank.resize(NODES * size);
+            m_empty_cells.resize(CELLS * size);
+            m_empty_pos.resize(CELLS * size);
+            m_num_empty.resize(size);
+            m_active_player.resize(size);
+            m_running.assign(size, 0);
+            m_finished.clear();
+            for (std::size_t g = 0; g < m_size && m_games_started < m_total_games; g++) {
+                m_start_game(g);
+            }
+        }
+
+        std::size_t size() const { return m_size; }
+        bool running(std::size_t g) const { return m_running[g]; }
+        bool done() const { return m_games_finished == m_total_games; }
+        unsigned activePlayer(std::size_t g) const { return m_active_player[g]; }
+
+        std::size_t gamesFinished() const { return m_games_finished; }
+        std::size_t wins(unsigned color) const { return m_wins[color]; }
+        std::vector<std::pair<std::size_t, unsigned>> const& lastFinished() const { return m_finished; }
+
+        bool has(std::size_t g, unsigned color, unsigned idx) const {
+            return (m_word(color, idx / 64, g) >> (idx % 64)) & 1;
+        }
+
+        TileState at(std::size_t g, unsigned idx) const {
+            if (has(g, Blue, idx)) { return Blue; }
+            if (has(g, Red, idx)) { return Red; }
+            return Empty;
+        }
+
+        unsigned numEmptyCells(std::size_t g) const { return m_num_empty[g]; }
+        unsigned emptyCell(std::size_t g, unsigned k) const { return m_empty_cells[k * m_size + g]; }
+
+        unsigned randomEmptyCell(std::size_t g) const {
+            return emptyCell(g, random::discrete(currentRng(), std::size_t(0), std::size_t(m_num_empty[g] - 1)));
+        }
+
+        // samples a move of game g from move preferences, using a softmax over the empty cells like
+        // Game::takeStrategyTurn. If rotated, the preferences are given in the counterclockwise rotated
+        // view of the red player; the returned move is always a cell of the board.
+        template <class Preferences>
+        unsigned sampleMove(std::size_t g, Preferences const& preferences, bool rotated) const {
+            RotationTable<N> const& rotation = RotationTable<N>::get();
+            uint8_t const* toView = (rotated ? rotation.toView : rotation.identity);
+            double legal[CELLS];
+            unsigned num_empty = m_num_empty[g];
+            for (unsigned k = 0; k < num_empty; k++) {
+                legal[k] = preferences(toView[emptyCell(g, k)]);
+            }
+            return emptyCell(g, sampleSoftmax(legal, num_empty, currentRng()));
+        }
+
+        // plays moves[g] in every running game g. Games that end are counted and their slot starts a
+        // new game if there are games left to play, otherwise the slot stays idle.
+        void step(unsigned const* moves) {
+            m_finished.clear();
+            for (std::size_t g = 0; g < m_size; g++) {
+                if (!m_running[g]) { continue; }
+                if (m_place(g, moves[g])) {
+                    unsigned winner = m_active_player[g];
+                    m_wins[winner]++;
+                    m_games_finished++;
+                    m_finished.push_back(std::make_pair(g, winner));
+                    m_running[g] = 0;
+                }
+            }
+            for (std::size_t g = 0; g < m_size; g++) {
+                m_active_player[g] ^= m_running[g];
+            }
+            for (std::size_t i = 0; i < m_finished.size() && m_games_started < m_total_games; i++) {
+                m_start_game(m_finished[i].first);
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef HEX_BOARD_HPP
+#define HEX_BOARD_HPP
+
+#include <cstdint>
+#include <utility>
+
+namespace Hex {
+
+    enum TileState : unsigned {
+        Blue = 0,
+        Red = 1,
+        Empty = 2
+    };
+
+    // Neighbours and edge membership of every cell of an N x N board, built at compile time.
+    // cells[idx] always has six entries, positions off the board refer to idx itself.
+    // edges[idx] has bit 2*color+side set if the cell touches that edge of the color.
+    template <unsigned N>
+    struct NeighbourTable {
+        uint8_t count[N * N];
+        uint8_t cells[N * N][6];
+        uint8_t edges[N * N];
+
+        constexpr NeighbourTable() : count(), cells(), edges() {
+            const int dr[6] = { 0,  1, -1, 1, -1, 0};
+            const int dc[6] = {-1, -1,  0, 0,  1, 1};
+            for (unsigned idx = 0; idx < N * N; idx++) {
+                int r = idx / N;
+                int c = idx % N;
+                unsigned n = 0;
+                for (unsigned k = 0; k < 6; k++) {
+                    int nr = r + dr[k];
+                    int nc = c + dc[k];
+                    if (nr >= 0 && nr < (int)N && nc >= 0 && nc < (int)N) {
+                        cells[idx][n++] = nr * N + nc;
+                    }
+                }
+                count[idx] = n;
+                for (unsigned k = n; k < 6; k++) {
+                    cells[idx][k] = idx;
+                }
+                edges[idx] = (c == 0 ? 1 : 0) | (c == (int)N - 1 ? 2 : 0)
+                           | (r == 0 ? 4 : 0) | (r == (int)N - 1 ? 8 : 0);
+            }
+        }
+    };
+
+    /*****************\
+     *  Board (bits)  *
+    \*****************/
+    // A compact, trivially copyable hex position: one bit-set per color and a flat union-find
+    // over the cells plus four virtual edge nodes (two per color). Cell (row, col) has index
+    // row * N + col. Blue connects the first and last column, Red the first and last row.
+    template <unsigned N>
+    class Board {
+        static_assert(N > 0 && N * N + 4 <= 256, "union-find nodes must fit in a byte");
+    public:
+        static const unsigned CELLS = N * N;
+        static const unsigned WORDS = (CELLS + 63) / 64;
+        static const unsigned NODES = CELLS + 4;
+
+        // Everything a placement changed, enough to take it back exactly. Each union made a
+        // former root the child of another root and possibly bumped the new root's rank.
+        struct Undo {
+            uint8_t cell;
+            uint8_t color;
+            uint8_t numLinks;
+            uint8_t rankBumped;
+            uint8_t links[8];
+        };
+
+    private:
+        static constexpr NeighbourTable<N> m_neighbours = NeighbourTable<N>();
+
+        uint64_t m_stones[2][WORDS];
+        uint8_t m_parent[NODES];
+        uint8_t m_rank[NODES];
+
+        static unsigned m_edge_node(unsigned color, unsigned side) {
+            return CELLS + 2 * color + side;
+        }
+
+        unsigned m_find(unsigned node) const {
+            while (m_parent[node] != node) {
+                node = m_parent[node];
+            }
+            return node;
+        }
+
+        // union by rank, the trees stay shallow enough that no path compression is needed
+        void m_union(unsigned a, unsigned b, Undo& undo) {
+            a = m_find(a);
+            b = m_find(b);
+            if (a == b) { return; }
+            if (m_rank[a] < m_rank[b]) { std::swap(a, b); }
+            m_parent[b] = a;
+            if (m_rank[a] == m_rank[b]) {
+                m_rank[a]++;
+                undo.rankBumped |= 1 << undo.numLinks;
+            }
+            undo.links[undo.numLinks++] = b;
+        }
+
+    public:
+        Board() { clear(); }
+
+        void clear() {
+            for (unsigned w = 0; w < WORDS; w++) {
+                m_stones[Blue][w] = 0;
+                m_stones[Red][w] = 0;
+            }
+            for (unsigned i = 0; i < NODES; i++) {
+                m_parent[i] = i;
+                m_rank[i] = 0;
+            }
+        }
+
+        static NeighbourTable<N> const& neighbourTable() {
+            return m_neighbours;
+        }
+
+        bool has(unsigned color, unsigned idx) const {
+            return (m_stones[color][idx / 64] >> (idx % 64)) & 1;
+        }
+
+        bool empty(unsigned idx) const {
+            return !has(Blue, idx) && !has(Red, idx);
+        }
+
+        TileState at(unsigned idx) const {
+            if (has(Blue, idx)) { return Blue; }
+            if (has(Red, idx)) { return Red; }
+            return Empty;
+        }
+
+        uint64_t const* stones(unsigned color) const { return m_stones[color]; }
+
+        unsigned numStones() const {
+            unsigned n = 0;
+            for (unsigned w = 0; w < WORDS; w++) {
+                n += __builtin_popcountll(m_stones[Blue][w] | m_stones[Red][w]);
+            }
+            return n;
+        }
+
+        // true if the color has connected its two edges
+        bool connected(unsigned color) const {
+            return m_find(m_edge_node(color, 0)) == m_find(m_edge_node(color, 1));
+        }
+
+        // puts a stone of the given color on an empty cell, returns true if it won the game
+        bool place(unsigned idx, TileState color) {
+            Undo undo;
+            return place(idx, color, undo);
+        }
+
+        // same as above, but records what changed so that unplace can revert it
+        bool place(unsigned idx, TileState color, Undo& undo) {
+            undo.cell = idx;
+            undo.color = color;
+            undo.numLinks = 0;
+            undo.rankBumped = 0;
+            m_stones[color][idx / 64] |= uint64_t(1) << (idx % 64);
+
+            unsigned edges = m_neighbours.edges[idx] >> (2 * color);
+            if (edges & 1) { m_union(idx, m_edge_node(color, 0), undo); }
+            if (edges & 2) { m_union(idx, m_edge_node(color, 1), undo); }
+
+            // off-board slots point back at the cell itself, so this loop has no bounds checks
+            for (unsigned k = 0; k < 6; k++) {
+                unsigned nb = m_neighbours.cells[idx][k];
+                if (has(color, nb)) {
+                    m_union(idx, nb, undo);
+                }
+            }
+            return connected(color);
+        }
+
+        // puts a stone without linking it into the union-find, for callers that detect wins by
+        // flood fill (see hex_flood.hpp). connected() does not see stones placed this way.
+        void placeUnlinked(unsigned idx, TileState color, Undo& undo) {
+            undo.cell = idx;
+            undo.color = color;
+            undo.numLinks = 0;
+            undo.rankBumped = 0;
+            m_stones[color][idx / 64] |= uint64_t(1) << (idx % 64);
+        }
+
+        // takes back the most recent placement that has not been undone yet
+        void unplace(Undo const& undo) {
+            for (unsigned k = undo.numLinks; k-- > 0;) {
+                unsigned child = undo.links[k];
+                if (undo.rankBumped & (1 << k)) {
+                    m_rank[m_parent[child]]--;
+                }
+                m_parent[child] = child;
+            }
+            m_stones[undo.color][undo.cell / 64] &= ~(uint64_t(1) << (undo.cell % 64));
+        }
+
+        // the position rotated by 180 degrees, each color keeps its own pair of edges
+        Board flipped() const {
+            Board res;
+            for (unsigned i = 0; i < CELLS; i++) {
+                TileState state = at(i);
+                if (state != Empty) {
+                    res.place(CELLS - 1 - i, state);
+                }
+            }
+            return res;
+        }
+    };
+
+    template <unsigned N>
+    constexpr NeighbourTable<N> Board<N>::m_neighbours;
+
+    // Index permutations between the board and the view of the red player, who sees the board
+    // rotated counterclockwise (see Strategy::rotateField): view cell (i, j) shows board cell
+    // (j, N-1-i). identity is the view of the blue player.
+    template <unsigned N>
+    struct RotationTable {
+        uint8_t toBoard[N * N];     // view index -> board index
+        uint8_t toView[N * N];      // board index -> view index
+        uint8_t identity[N * N];
+
+        constexpr RotationTable() : toBoard(), toView(), identity() {
+            for (unsigned v = 0; v < N * N; v++) {
+                unsigned idx = v % N * N + N - 1 - v / N;
+                toBoard[v] = idx;
+                toView[idx] = v;
+                identity[v] = v;
+            }
+        }
+
+        static RotationTable const& get() {
+            static constexpr RotationTable table = RotationTable();
+            return table;
+        }
+    };
+
+    // A non-owning view of a board as one of the players sees it, reading through the rotation
+    // table instead of copying the board.
+    template <unsigned N>
+    class BoardView {
+        Board<N> const& m_board;
+        uint8_t const* m_to_board;
+
+    public:
+        BoardView(Board<N> const& board, bool rotated)
+        : m_board(board),
+          m_to_board(rotated ? RotationTable<N>::get().toBoard : RotationTable<N>::get().identity) {}
+
+        bool rotated() const { return m_to_board == RotationTable<N>::get().toBoard; }
+
+        // board index of a view index
+        unsigned toBoard(unsigned v) const { return m_to_board[v]; }
+
+        TileState at(unsigned v) const { return m_board.at(m_to_board[v]); }
+        TileState operator()(unsigned i, unsigned j) const { return at(i * N + j); }
+    };
+}
+
+#endif
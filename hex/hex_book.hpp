@@ -0,0 +1,208 @@
+#ifndef HEX_BOOK_HPP
+#define HEX_BOOK_HPP
+
+#include "hex_board.hpp"
+#include "hex_zobrist.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Hex {
+
+    /*******************\
+     *  Opening books  *
+    \*******************/
+    // Binary opening books. A file starts with an OpeningBookFileHeader, followed by the entries
+    // sorted by key, so a mapped file is searched in place. All fields are little endian and fixed
+    // size.
+    //
+    // The key of a position is the Zobrist hash of the board as the player to move sees it: blue
+    // as is, red transposed, which turns red's rows into columns and keeps hex adjacency. The
+    // smaller of the hashes of that view and of the view rotated by 180 degrees is the key, and
+    // the move is stored as an index of the same view. Both are symmetries of the game, so unlike
+    // Game::hash(), which shows red the rotated board of the networks, positions with the same key
+    // are the same position.
+    struct OpeningBookFileHeader {
+        char magic[4];          // "HXOB"
+        uint32_t version;
+        uint32_t boardSize;
+        uint32_t reserved;
+        uint64_t numEntries;
+    };
+
+    struct OpeningBookEntry {
+        uint64_t key;
+        float value;            // chance to win of the player to move
+        uint16_t depth;         // plies searched
+        uint8_t move;           // view index of the key's orientation
+        uint8_t reserved;
+    };
+
+    static_assert(sizeof(OpeningBookFileHeader) == 24, "opening book header must be packed");
+    static_assert(sizeof(OpeningBookEntry) == 16, "opening book entry must be packed");
+
+    static const char OPENING_BOOK_MAGIC[4] = {'H', 'X', 'O', 'B'};
+    static const uint32_t OPENING_BOOK_VERSION = 1;
+
+    // the key of a position and the conversion of its moves from and to board cells
+    template <unsigned N>
+    struct BookPosition {
+        uint64_t key;
+        unsigned player;
+        bool flipped;           // whether the key is the hash of the view rotated by 180 degrees
+
+        BookPosition(Board<N> const& board, unsigned player_to_move) : player(player_to_move) {
+            ZobristKeys<N> const& zobrist = ZobristKeys<N>::get();
+            uint64_t hashes[2] = {0, 0};
+            for (unsigned cell = 0; cell < N * N; cell++) {
+                TileState state = board.at(cell);
+                if (state != Empty) {
+                    unsigned view = m_view(cell);
+                    unsigned side = (state == player ? 0 : 1);
+                    hashes[0] ^= zobrist.keys[side][view];
+                    hashes[1] ^= zobrist.keys[side][N * N - 1 - view];
+                }
+            }
+            flipped = hashes[1] < hashes[0];
+            key = std::min(hashes[0], hashes[1]);
+        }
+
+        unsigned toMove(unsigned cell) const {
+            unsigned view = m_view(cell);
+            return flipped ? N * N - 1 - view : view;
+        }
+
+        unsigned toCell(unsigned move) const {
+            return m_view(flipped ? N * N - 1 - move : move);
+        }
+
+    private:
+        // the view of red is the transposed board, which is its own inverse
+        unsigned m_view(unsigned cell) const {
+            return player == Red ? cell % N * N + cell / N : cell;
+        }
+    };
+
+    // Writes the entries of a book for the given board size, sorted by key. Like writeModelFile
+    // the file is written next to path and renamed over it.
+    inline void writeOpeningBook(std::string const& path, unsigned board_size, std::vector<OpeningBookEntry> entries) {
+        std::sort(entries.begin(), entries.end(),
+                  [](OpeningBookEntry const& a, OpeningBookEntry const& b) { return a.key < b.key; });
+        for (std::size_t k = 1; k < entries.size(); k++) {
+            if (entries[k].key == entries[k - 1].key) {
+                throw std::invalid_argument("writeOpeningBook: two entries of the same position");
+            }
+        }
+        OpeningBookFileHeader header;
+        std::memcpy(header.magic, OPENING_BOOK_MAGIC, 4);
+        header.version = OPENING_BOOK_VERSION;
+        header.boardSize = board_size;
+        header.reserved = 0;
+        header.numEntries = entries.size();
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            out.write(reinterpret_cast<char const*>(entries.data()), entries.size() * sizeof(OpeningBookEntry));
+            if (!out) {
+                throw std::runtime_error("cannot write opening book " + temporary);
+            }
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("cannot write opening book " + path);
+        }
+    }
+
+    // Maps a book read-only, shared between the processes that load it, and finds positions by
+    // binary search. Strategies consult it through Strategy::setOpeningBook.
+    template <unsigned N>
+    class OpeningBook {
+        int m_fd = -1;
+        uint8_t const* m_data = nullptr;
+        std::size_t m_size = 0;
+        OpeningBookEntry const* m_entries = nullptr;
+        std::size_t m_num_entries = 0;
+
+        void m_fail(std::string const& what, std::string const& path) {
+            if (m_data) { munmap(const_cast<uint8_t*>(m_data), m_size); }
+            close(m_fd);
+            throw std::runtime_error(what + " " + path);
+        }
+
+    public:
+        explicit OpeningBook(std::string const& path) {
+            m_fd = open(path.c_str(), O_RDONLY);
+            if (m_fd < 0) {
+                throw std::runtime_error("cannot open opening book " + path);
+            }
+            struct stat st;
+            fstat(m_fd, &st);
+            m_size = st.st_size;
+            if (m_size < sizeof(OpeningBookFileHeader)) {
+                m_fail("not an opening book:", path);
+            }
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+            if (data == MAP_FAILED) {
+                m_fail("cannot map opening book", path);
+            }
+            m_data = static_cast<uint8_t const*>(data);
+
+            OpeningBookFileHeader const* header = reinterpret_cast<OpeningBookFileHeader const*>(m_data);
+            if (std::memcmp(header->magic, OPENING_BOOK_MAGIC, 4) != 0 || header->version != OPENING_BOOK_VERSION
+                || sizeof(OpeningBookFileHeader) + header->numEntries * sizeof(OpeningBookEntry) != m_size) {
+                m_fail("not an opening book:", path);
+            }
+            if (header->boardSize != N) {
+                m_fail("the board size does not match the opening book", path);
+            }
+            m_entries = reinterpret_cast<OpeningBookEntry const*>(m_data + sizeof(OpeningBookFileHeader));
+            m_num_entries = header->numEntries;
+        }
+
+        ~OpeningBook() {
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+            close(m_fd);
+        }
+
+        OpeningBook(OpeningBook const&) = delete;
+        OpeningBook& operator=(OpeningBook const&) = delete;
+
+        std::size_t size() const { return m_num_entries; }
+
+        // the entry of a key, nullptr if the book does not have the position
+        OpeningBookEntry const* find(uint64_t key) const {
+            OpeningBookEntry const* end = m_entries + m_num_entries;
+            OpeningBookEntry const* entry = std::lower_bound(m_entries, end, key,
+                [](OpeningBookEntry const& e, uint64_t k) { return e.key < k; });
+            return (entry != end && entry->key == key) ? entry : nullptr;
+        }
+
+        // The book move of the player to move and its value, like Strategy::getChosenMove returns
+        // them. False if the book does not have the position, or if its move is taken, which only
+        // a collision of keys can cause.
+        bool find(Board<N> const& board, unsigned player, std::pair<double, int>& chosen) const {
+            BookPosition<N> position(board, player);
+            OpeningBookEntry const* entry = find(position.key);
+            if (!entry || entry->move >= N * N || !board.empty(position.toCell(entry->move))) {
+                return false;
+            }
+            chosen = std::pair<double, int>(entry->value, position.toCell(entry->move));
+            return true;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef HEX_CACHE_HPP
+#define HEX_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace Hex {
+
+    /****************\
+     *  Eval cache  *
+    \****************/
+    // A fixed size, direct mapped table of network values keyed by Game::hash(). Threads may look up
+    // and store concurrently without locks: every slot holds the value and the key xor the value, so
+    // a slot torn by two concurrent stores fails the check and reads as a miss. New values always
+    // replace old ones. clear() starts a new generation, which makes every stored value a miss, so
+    // it is cheap enough to call whenever the network parameters change.
+    class EvalCache {
+        struct Slot {
+            std::atomic<uint64_t> check;
+            std::atomic<uint64_t> data;
+        };
+
+        std::unique_ptr<Slot[]> m_slots;
+        uint64_t m_mask;
+        std::atomic<uint64_t> m_generation;
+        std::atomic<uint64_t> m_hits;
+        std::atomic<uint64_t> m_lookups;
+
+        uint64_t m_key(uint64_t hash) const {
+            return hash ^ (m_generation.load(std::memory_order_relaxed) * 0x9E3779B97F4A7C15ULL);
+        }
+
+    public:
+        // a cache with 2^log2_slots slots
+        explicit EvalCache(unsigned log2_slots = 18)
+        : m_slots(new Slot[std::size_t(1) << log2_slots]), m_mask((uint64_t(1) << log2_slots) - 1),
+          m_generation(1), m_hits(0), m_lookups(0) {
+            for (uint64_t i = 0; i <= m_mask; i++) {
+                m_slots[i].check.store(0, std::memory_order_relaxed);
+                m_slots[i].data.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        bool lookup(uint64_t hash, double& value) {
+            m_lookups.fetch_add(1, std::memory_order_relaxed);
+            uint64_t key = m_key(hash);
+            Slot const& slot = m_slots[key & m_mask];
+            uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if ((slot.check.load(std::memory_order_relaxed) ^ data) != key) {
+                return false;
+            }
+            std::memcpy(&value, &data, sizeof(double));
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        void store(uint64_t hash, double value) {
+            uint64_t key = m_key(hash);
+            uint64_t data;
+            std::memcpy(&data, &value, sizeof(double));
+            Slot& slot = m_slots[key & m_mask];
+            slot.check.store(key ^ data, std::memory_order_relaxed);
+            slot.data.store(data, std::memory_order_relaxed);
+        }
+
+        void clear() {
+            m_generation.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        uint64_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+        uint64_t lookups() const { return m_lookups.load(std::memory_order_relaxed); }
+        double hitRate() const {
+            uint64_t n = lookups();
+            return n ? double(hits()) / n : 0.0;
+        }
+    };
+}
+
+#endif
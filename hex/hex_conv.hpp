@@ -0,0 +1,296 @@
+#ifndef HEX_CONV_HPP
+#define HEX_CONV_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace Hex {
+
+    /*******************************\
+     *  Hex convolution inference  *
+    \*******************************/
+    // Forward pass of the network of ConvNetworkStrategy without Shark. The board is an image of
+    // SIZE x SIZE cells, the N x N cells inside a border of edge cells, in CHANNELS one-hot planes:
+    // own stones and edges, the opponent's stones and edges, and empty cells. Every layer but the
+    // last convolves the image with hexagonal kernels, a cell and its six neighbours: the 3 x 3
+    // kernel of Shark's Conv2DModel without the taps (-1,-1) and (1,1), which are not adjacent on a
+    // hex board. Cells outside the image count as zero, like Conv2DModel's zero padding, so the image
+    // keeps its size. The last layer is a dense logistic unit over the filters of every cell.
+    //
+    // The convolutions are computed directly, without an im2col matrix: the filters of an output
+    // cell are the sum over its taps of the weight rows of the tap, scaled by the channels of the
+    // neighbour, 8 filters per FMA with the sums kept in registers. Weights are float32 and stored
+    // per layer as [tap][input][filter] with the filters padded to a multiple of 8, activations as
+    // [cell][filter] with the same padding.
+    // The inputs of the first layer are one-hot, so it only adds a weight row per tap. Like
+    // MLPInference, one object is used by one thread.
+    template <unsigned N>
+    class HexConvInference {
+    public:
+        static const unsigned SIZE = N + 2;
+        static const unsigned CELLS = SIZE * SIZE;
+        static const unsigned CHANNELS = 3;
+        static const unsigned TAPS = 7;
+        // the plane of the corners of the border, which belong to no edge
+        static const uint8_t NO_PLANE = 255;
+
+        // whether tap (a, b) of a 3 x 3 Conv2DModel kernel, centered on (1, 1), is one of the hex kernel
+        static bool isHexTap(unsigned a, unsigned b) {
+            return !(a == 0 && b == 0) && !(a == 2 && b == 2);
+        }
+
+    private:
+        struct Layer {
+            unsigned inputs;
+            unsigned filters;
+            unsigned padded;        // filters rounded up to a multiple of 8
+            std::size_t weights;    // position of the [tap][input][padded] weights in m_weights
+            std::size_t offsets;    // position of the padded offsets in m_weights
+        };
+
+        std::vector<Layer> m_layers;
+        std::vector<float> m_weights;
+        std::size_t m_head;         // position of the [cell][padded] weights of the logistic unit
+        mutable std::vector<float> m_scratch[2];
+
+        // per cell the neighbours in the image and the tap they are, the cell itself first
+        uint16_t m_neighbours[CELLS][TAPS];
+        uint8_t m_taps[CELLS][TAPS];
+        uint8_t m_counts[CELLS];
+
+        // the tap offsets (row, column), tap t is (a, b) = (row + 1, column + 1) of a 3 x 3 kernel
+        static int m_row(unsigned tap) { static const int rows[TAPS] = {0, -1, -1, 0, 0, 1, 1}; return rows[tap]; }
+        static int m_column(unsigned tap) { static const int columns[TAPS] = {0, 0, 1, -1, 1, -1, 0}; return columns[tap]; }
+
+        // the first layer: the offsets plus the weight row of the plane of each neighbour
+        void m_gather(Layer const& layer, uint8_t const* planes, float* out) const {
+            float const* weights = m_weights.data() + layer.weights;
+            float const* offsets = m_weights.data() + layer.offsets;
+            for (unsigned cell = 0; cell < CELLS; cell++) {
+                // the weight rows of the taps whose neighbour lies in a plane
+                float const* rows[TAPS];
+                unsigned num_rows = 0;
+                for (unsigned k = 0; k < m_counts[cell]; k++) {
+                    uint8_t plane = planes[m_neighbours[cell][k]];
+                    if (plane != NO_PLANE) {
+                        rows[num_rows++] = weights + (std::size_t(m_taps[cell][k]) * layer.inputs + plane) * layer.padded;
+                    }
+                }
+                float* acc = out + std::size_t(cell) * layer.padded;
+                unsigned o = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+                for (; o < layer.padded; o += 8) {
+                    __m256 sum = _mm256_loadu_ps(offsets + o);
+                    for (unsigned r = 0; r < num_rows; r++) {
+                        sum = _mm256_add_ps(sum, _mm256_loadu_ps(rows[r] + o));
+                    }
+                    _mm256_storeu_ps(acc + o, _mm256_max_ps(sum, _mm256_setzero_ps()));
+                }
+#endif
+                for (; o < layer.padded; o++) {
+                    float sum = offsets[o];
+                    for (unsigned r = 0; r < num_rows; r++) {
+                        sum += rows[r][o];
+                    }
+                    acc[o] = std::max(sum, 0.0f);
+                }
+            }
+        }
+
+        // a later layer, in holds the padded filters of the previous one per cell. The sums of 16
+        // filters stay in registers over all taps and inputs, split in two chains of FMAs by the
+        // parity of the input so consecutive FMAs do not wait for each other.
+        void m_convolve(Layer const& layer, unsigned in_padded, float const* in, float* out) const {
+            float const* weights = m_weights.data() + layer.weights;
+            float const* offsets = m_weights.data() + layer.offsets;
+            std::size_t tap_size = std::size_t(layer.inputs) * layer.padded;
+            for (unsigned cell = 0; cell < CELLS; cell++) {
+                float* acc = out + std::size_t(cell) * layer.padded;
+                unsigned o = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+                for (; o + 16 <= layer.padded; o += 16) {
+                    __m256 even0 = _mm256_loadu_ps(offsets + o);
+                    __m256 even1 = _mm256_loadu_ps(offsets + o + 8);
+                    __m256 odd0 = _mm256_setzero_ps();
+                    __m256 odd1 = _mm256_setzero_ps();
+                    for (unsigned k = 0; k < m_counts[cell]; k++) {
+                        float const* x = in + std::size_t(m_neighbours[cell][k]) * in_padded;
+                        float const* w = weights + m_taps[cell][k] * tap_size + o;
+                        unsigned i = 0;
+                        for (; i + 2 <= layer.inputs; i += 2, w += 2 * layer.padded) {
+                            __m256 x0 = _mm256_set1_ps(x[i]);
+                            __m256 x1 = _mm256_set1_ps(x[i + 1]);
+                            even0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(w), even0);
+                            even1 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(w + 8), even1);
+                            odd0 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(w + layer.padded), odd0);
+                            odd1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(w + layer.padded + 8), odd1);
+                        }
+                        if (i < layer.inputs) {
+                            __m256 x0 = _mm256_set1_ps(x[i]);
+                            even0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(w), even0);
+                            even1 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(w + 8), even1);
+                        }
+                    }
+                    __m256 zero = _mm256_setzero_ps();
+                    _mm256_storeu_ps(acc + o, _mm256_max_ps(_mm256_add_ps(even0, odd0), zero));
+                    _mm256_storeu_ps(acc + o + 8, _mm256_max_ps(_mm256_add_ps(even1, odd1), zero));
+                }
+                for (; o < layer.padded; o += 8) {
+                    __m256 even = _mm256_loadu_ps(offsets + o);
+                    __m256 odd = _mm256_setzero_ps();
+                    for (unsigned k = 0; k < m_counts[cell]; k++) {
+                        float const* x = in + std::size_t(m_neighbours[cell][k]) * in_padded;
+                        float const* w = weights + m_taps[cell][k] * tap_size + o;
+                        unsigned i = 0;
+                        for (; i + 2 <= layer.inputs; i += 2, w += 2 * layer.padded) {
+                            even = _mm256_fmadd_ps(_mm256_set1_ps(x[i]), _mm256_loadu_ps(w), even);
+                            odd = _mm256_fmadd_ps(_mm256_set1_ps(x[i + 1]), _mm256_loadu_ps(w + layer.padded), odd);
+                        }
+                        if (i < layer.inputs) {
+                            even = _mm256_fmadd_ps(_mm256_set1_ps(x[i]), _mm256_loadu_ps(w), even);
+                        }
+                    }
+                    _mm256_storeu_ps(acc + o, _mm256_max_ps(_mm256_add_ps(even, odd), _mm256_setzero_ps()));
+                }
+#else
+                for (; o < layer.padded; o++) {
+                    acc[o] = offsets[o];
+                }
+                for (unsigned k = 0; k < m_counts[cell]; k++) {
+                    float const* x = in + std::size_t(m_neighbours[cell][k]) * in_padded;
+                    float const* w = weights + m_taps[cell][k] * tap_size;
+                    for (unsigned i = 0; i < layer.inputs; i++, w += layer.padded) {
+                        for (o = 0; o < layer.padded; o++) {
+                            acc[o] += x[i] * w[o];
+                        }
+                    }
+                }
+                for (o = 0; o < layer.padded; o++) {
+                    acc[o] = std::max(acc[o], 0.0f);
+                }
+#endif
+            }
+        }
+
+    public:
+        // convolutions with filters[l] filters each, the first over the input planes
+        explicit HexConvInference(std::vector<unsigned> const& filters) {
+            if (filters.empty()) {
+                throw std::invalid_argument("HexConvInference: the network needs a convolution");
+            }
+            unsigned inputs = CHANNELS;
+            for (unsigned count : filters) {
+                Layer layer;
+                layer.inputs = inputs;
+                layer.filters = count;
+                layer.padded = (count + 7) / 8 * 8;
+                layer.weights = m_weights.size();
+                layer.offsets = layer.weights + std::size_t(TAPS) * inputs * layer.padded;
+                m_weights.resize(layer.offsets + layer.padded, 0.0f);
+                m_layers.push_back(layer);
+                inputs = count;
+            }
+            m_head = m_weights.size();
+            m_weights.resize(m_head + std::size_t(CELLS) * m_layers.back().padded, 0.0f);
+            std::size_t width = 0;
+            for (Layer const& layer : m_layers) {
+                width = std::max(width, std::size_t(CELLS) * layer.padded);
+            }
+            m_scratch[0].assign(width, 0.0f);
+            m_scratch[1].assign(width, 0.0f);
+
+            for (unsigned cell = 0; cell < CELLS; cell++) {
+                m_counts[cell] = 0;
+                for (unsigned tap = 0; tap < TAPS; tap++) {
+                    int row = int(cell / SIZE) + m_row(tap);
+                    int column = int(cell % SIZE) + m_column(tap);
+                    if (row >= 0 && row < int(SIZE) && column >= 0 && column < int(SIZE)) {
+                        m_neighbours[cell][m_counts[cell]] = row * SIZE + column;
+                        m_taps[cell][m_counts[cell]++] = tap;
+                    }
+                }
+            }
+        }
+
+        // parameters of the Shark network, whose kernels are 3 x 3 with the corner taps kept at zero
+        std::size_t numberOfParameters() const {
+            std::size_t n = 0;
+            for (Layer const& layer : m_layers) {
+                n += std::size_t(layer.filters) * 9 * layer.inputs + layer.filters;
+            }
+            return n + std::size_t(CELLS) * m_layers.back().filters;
+        }
+
+        // Copies the weights from a parameter vector laid out like ConcatenatedModel::parameterVector()
+        // of Conv2DModel layers and a LinearModel: per convolution the filters [filter][a][b][input],
+        // a and b the row and column of the 3 x 3 kernel, then the offsets; then the weights of the
+        // logistic unit, indexed by [cell][filter] like the outputs of Conv2DModel. The corner taps
+        // are not read.
+        template <class Parameters>
+        void setParameters(Parameters const& parameters) {
+            if (parameters.size() != numberOfParameters()) {
+                throw std::invalid_argument("HexConvInference: wrong number of parameters");
+            }
+            std::size_t p = 0;
+            for (Layer const& layer : m_layers) {
+                float* weights = m_weights.data() + layer.weights;
+                for (unsigned f = 0; f < layer.filters; f++) {
+                    for (unsigned tap = 0; tap < TAPS; tap++) {
+                        std::size_t kernel = p + (std::size_t(f) * 9 + (m_row(tap) + 1) * 3 + (m_column(tap) + 1)) * layer.inputs;
+                        for (unsigned i = 0; i < layer.inputs; i++) {
+                            weights[(std::size_t(tap) * layer.inputs + i) * layer.padded + f] = float(parameters(kernel + i));
+                        }
+                    }
+                }
+                p += std::size_t(layer.filters) * 9 * layer.inputs;
+                for (unsigned f = 0; f < layer.filters; f++) {
+                    m_weights[layer.offsets + f] = float(parameters(p++));
+                }
+            }
+            Layer const& last = m_layers.back();
+            for (unsigned cell = 0; cell < CELLS; cell++) {
+                for (unsigned f = 0; f < last.filters; f++) {
+                    m_weights[m_head + std::size_t(cell) * last.padded + f] = float(parameters(p++));
+                }
+            }
+        }
+
+        // the value of the image whose cell k lies in plane planes[k], or NO_PLANE
+        float eval(uint8_t const* planes) const {
+            m_gather(m_layers[0], planes, m_scratch[0].data());
+            for (std::size_t l = 1; l < m_layers.size(); l++) {
+                m_convolve(m_layers[l], m_layers[l - 1].padded, m_scratch[(l - 1) % 2].data(), m_scratch[l % 2].data());
+            }
+            Layer const& last = m_layers.back();
+            float const* in = m_scratch[(m_layers.size() - 1) % 2].data();
+            float const* w = m_weights.data() + m_head;
+            std::size_t n = std::size_t(CELLS) * last.padded;
+            std::size_t k = 0;
+            float sum = 0.0f;
+#if defined(__AVX2__) && defined(__FMA__)
+            __m256 acc = _mm256_setzero_ps();
+            for (; k < n; k += 8) {
+                acc = _mm256_fmadd_ps(_mm256_loadu_ps(in + k), _mm256_loadu_ps(w + k), acc);
+            }
+            float lanes[8];
+            _mm256_storeu_ps(lanes, acc);
+            for (unsigned l = 0; l < 8; l++) {
+                sum += lanes[l];
+            }
+#endif
+            for (; k < n; k++) {
+                sum += in[k] * w[k];
+            }
+            return 1.0f / (1.0f + std::exp(-sum));
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef HEX_EMBEDDED_HPP
+#define HEX_EMBEDDED_HPP
+
+#include "hex_mlp.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Hex {
+
+    /*********************\
+     *  Embedded models  *
+    \*********************/
+    // A model compiled into the executable: writeEmbeddedHeader turns the weights of a model into a
+    // header of constexpr EmbeddedLayers, and embeddedEval evaluates them with every size known at
+    // compile time, keeping the activations on the stack. Nothing is loaded or allocated at startup,
+    // which is what the hex_play executable (hex_play.cpp) is built for.
+    template <unsigned Inputs, unsigned Outputs, Activation A>
+    struct EmbeddedLayer {
+        static constexpr unsigned inputs = Inputs;
+        static constexpr unsigned outputs = Outputs;
+        static constexpr Activation activation = A;
+        float weights[Inputs][Outputs];     // transposed like in MLPInference, [input][output]
+        float offsets[Outputs];             // zero for layers without offsets
+    };
+
+    // out = activation(offsets + sum_i in[i] * weights[i]), inputs that are 0 (empty cells) are skipped
+    template <unsigned Inputs, unsigned Outputs, Activation A>
+    inline void embeddedLayer(EmbeddedLayer<Inputs, Outputs, A> const& layer, float const* in, float* out) {
+        for (unsigned o = 0; o < Outputs; o++) {
+            out[o] = layer.offsets[o];
+        }
+        for (unsigned i = 0; i < Inputs; i++) {
+            if (in[i] == 0.0f) { continue; }
+            for (unsigned o = 0; o < Outputs; o++) {
+                out[o] += in[i] * layer.weights[i][o];
+            }
+        }
+        if (A == Activation::Rectifier) {
+            for (unsigned o = 0; o < Outputs; o++) {
+                out[o] = std::max(out[o], 0.0f);
+            }
+        } else if (A == Activation::Logistic) {
+            for (unsigned o = 0; o < Outputs; o++) {
+                out[o] = 1.0f / (1.0f + std::exp(-out[o]));
+            }
+        }
+    }
+
+    template <class Last>
+    inline void embeddedEval(float const* in, float* out, Last const& last) {
+        embeddedLayer(last, in, out);
+    }
+
+    // evaluates the layers in order, out holds the outputs of the last one
+    template <class First, class... Rest>
+    inline void embeddedEval(float const* in, float* out, First const& first, Rest const&... rest) {
+        float hidden[First::outputs];
+        embeddedLayer(first, in, hidden);
+        embeddedEval(hidden, out, rest...);
+    }
+
+    // a float literal that reads back as the same float
+    inline std::string embeddedFloatLiteral(double value) {
+        if (!std::isfinite(float(value))) {
+            throw std::invalid_argument("writeEmbeddedHeader: the model has weights that are not finite");
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.9g", float(value));
+        std::string literal(text);
+        if (literal.find_first_of(".e") == std::string::npos) {
+            literal += ".0";
+        }
+        return literal + "f";
+    }
+
+    // Writes the header of a model, the parameters (anything with size() and operator()) laid out
+    // like ConcatenatedModel::parameterVector(). It defines Hex::EmbeddedModel::BOARD_SIZE, STRATEGY
+    // (the Strategy::type() the model was trained for), OUTPUTS, the layers and evaluate(input, output).
+    template <class Parameters>
+    void writeEmbeddedHeader(std::string const& path, std::string const& source, unsigned board_size, int strategy,
+                             std::vector<LayerShape> const& shapes, Parameters const& parameters) {
+        static const char* activations[3] = {"Activation::Linear", "Activation::Rectifier", "Activation::Logistic"};
+        std::size_t count = 0;
+        for (LayerShape const& shape : shapes) {
+            count += std::size_t(shape.inputs) * shape.outputs + (shape.offset ? shape.outputs : 0);
+        }
+        if (count != std::size_t(parameters.size())) {
+            throw std::invalid_argument("writeEmbeddedHeader: the parameters do not match the layers");
+        }
+
+        std::ofstream out(path, std::ios::trunc);
+        out << "// Generated from " << source << " by hex, do not edit.\n"
+            << "#ifndef HEX_EMBEDDED_MODEL_HPP\n#define HEX_EMBEDDED_MODEL_HPP\n\n"
+            << "#include \"hex_embedded.hpp\"\n\n"
+            << "namespace Hex {\nnamespace EmbeddedModel {\n"
+            << "    constexpr unsigned BOARD_SIZE = " << board_size << ";\n"
+            << "    constexpr int STRATEGY = " << strategy << ";\n"
+            << "    constexpr unsigned OUTPUTS = " << shapes.back().outputs << ";\n\n";
+
+        std::size_t p = 0;
+        for (std::size_t l = 0; l < shapes.size(); l++) {
+            LayerShape const& shape = shapes[l];
+            // Shark keeps the weights as outputs x inputs, the layer stores them transposed
+            std::vector<std::vector<double>> weights(shape.inputs, std::vector<double>(shape.outputs));
+            for (unsigned o = 0; o < shape.outputs; o++) {
+                for (unsigned i = 0; i < shape.inputs; i++) {
+                    weights[i][o] = parameters(p++);
+                }
+            }
+            out << "    alignas(32) constexpr EmbeddedLayer<" << shape.inputs << ", " << shape.outputs << ", "
+                << activations[int(shape.activation)] << "> layer" << l << " = {\n        {\n";
+            for (unsigned i = 0; i < shape.inputs; i++) {
+                out << "            {";
+                for (unsigned o = 0; o < shape.outputs; o++) {
+                    out << (o ? ", " : "") << embeddedFloatLiteral(weights[i][o]);
+                }
+                out << "},\n";
+            }
+            out << "        },\n        {";
+            for (unsigned o = 0; o < shape.outputs; o++) {
+                out << (o ? ", " : "") << (shape.offset ? embeddedFloatLiteral(parameters(p++)) : "0.0f");
+            }
+            out << "}\n    };\n\n";
+        }
+        out << "    // the OUTPUTS outputs of the network for the input\n"
+            << "    inline void evaluate(float const* input, float* output) {\n"
+            << "        embeddedEval(input, output";
+        for (std::size_t l = 0; l < shapes.size(); l++) {
+            out << ", layer" << l;
+        }
+        out << ");\n    }\n}\n}\n\n#endif\n";
+        if (!out) {
+            throw std::runtime_error("cannot write embedded model header " + path);
+        }
+    }
+}
+
+#endif
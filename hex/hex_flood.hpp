@@ -0,0 +1,154 @@
+#ifndef HEX_FLOOD_HPP
+#define HEX_FLOOD_HPP
+
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace Hex {
+
+    /*****************\
+     *  Flood fill   *
+    \*****************/
+    // Bit-parallel win detection on the stone bit-sets of a Board. A group is grown by shifting the
+    // whole set onto its six hex neighbours at once (masking the shifts that would wrap around a row)
+    // and intersecting with the stones, until nothing changes. All sizes fit in 256 bits, so with AVX2
+    // one step is a handful of instructions on a single register.
+    template <unsigned N>
+    class FloodFill {
+        static_assert(N * N <= 256, "flood fill works on at most 256 cells");
+        static const unsigned CELLS = N * N;
+        static const unsigned WORDS = (CELLS + 63) / 64;
+
+        struct Masks {
+            uint64_t notFirstCol[4];
+            uint64_t notLastCol[4];
+            uint64_t edge[2][2][4];     // [color][side], Blue owns the columns and Red the rows
+
+            constexpr Masks() : notFirstCol(), notLastCol(), edge() {
+                for (unsigned idx = 0; idx < CELLS; idx++) {
+                    unsigned r = idx / N;
+                    unsigned c = idx % N;
+                    uint64_t bit = uint64_t(1) << (idx % 64);
+                    if (c != 0)     { notFirstCol[idx / 64] |= bit; }
+                    if (c != N - 1) { notLastCol[idx / 64] |= bit; }
+                    if (c == 0)     { edge[0][0][idx / 64] |= bit; }
+                    if (c == N - 1) { edge[0][1][idx / 64] |= bit; }
+                    if (r == 0)     { edge[1][0][idx / 64] |= bit; }
+                    if (r == N - 1) { edge[1][1][idx / 64] |= bit; }
+                }
+            }
+        };
+        static constexpr Masks m_masks = Masks();
+
+#ifdef __AVX2__
+        static __m256i m_load(uint64_t const* words) {
+            return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(words));
+        }
+
+        // shifts of the whole 256 bit register, carrying bits across the 64 bit lanes
+        template <int S>
+        static __m256i m_shift_up(__m256i x) {
+            __m256i carry = _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), _mm256_setzero_si256(), 0x03);
+            return _mm256_or_si256(_mm256_slli_epi64(x, S), _mm256_srli_epi64(carry, 64 - S));
+        }
+        template <int S>
+        static __m256i m_shift_down(__m256i x) {
+            __m256i carry = _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 2, 1)), _mm256_setzero_si256(), 0xC0);
+            return _mm256_or_si256(_mm256_srli_epi64(x, S), _mm256_slli_epi64(carry, 64 - S));
+        }
+
+        static bool m_grow(uint64_t const* stones, uint64_t* group, unsigned color) {
+            __m256i own = m_load(stones);
+            __m256i notFirst = m_load(m_masks.notFirstCol);
+            __m256i notLast = m_load(m_masks.notLastCol);
+            __m256i x = m_load(group);
+            while (true) {
+                __m256i next = _mm256_or_si256(x, _mm256_or_si256(m_shift_up<N>(x), m_shift_down<N>(x)));
+                next = _mm256_or_si256(next, _mm256_and_si256(_mm256_or_si256(m_shift_up<1>(x), m_shift_down<N - 1>(x)), notFirst));
+                next = _mm256_or_si256(next, _mm256_and_si256(_mm256_or_si256(m_shift_down<1>(x), m_shift_up<N - 1>(x)), notLast));
+                next = _mm256_and_si256(next, own);
+                __m256i changed = _mm256_xor_si256(next, x);
+                x = next;
+                if (_mm256_testz_si256(changed, changed)) { break; }
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(group), x);
+            return !_mm256_testz_si256(x, m_load(m_masks.edge[color][0]))
+                && !_mm256_testz_si256(x, m_load(m_masks.edge[color][1]));
+        }
+#else
+        static void m_shift_up(uint64_t const* x, unsigned s, uint64_t* out) {
+            for (unsigned w = 4; w-- > 1;) {
+                out[w] = (x[w] << s) | (x[w - 1] >> (64 - s));
+            }
+            out[0] = x[0] << s;
+        }
+        static void m_shift_down(uint64_t const* x, unsigned s, uint64_t* out) {
+            for (unsigned w = 0; w < 3; w++) {
+                out[w] = (x[w] >> s) | (x[w + 1] << (64 - s));
+            }
+            out[3] = x[3] >> s;
+        }
+
+        static bool m_grow(uint64_t const* stones, uint64_t* x, unsigned color) {
+            // neighbours of cell idx are idx +-1, idx +-N and idx +-(N-1)
+            uint64_t plusN[4], minusN[4], plus1[4], minus1[4], plusN1[4], minusN1[4];
+            bool changed = true;
+            while (changed) {
+                m_shift_up(x, N, plusN);
+                m_shift_down(x, N, minusN);
+                m_shift_up(x, 1, plus1);
+                m_shift_down(x, 1, minus1);
+                m_shift_up(x, N - 1, plusN1);
+                m_shift_down(x, N - 1, minusN1);
+                changed = false;
+                for (unsigned w = 0; w < 4; w++) {
+                    uint64_t next = x[w] | plusN[w] | minusN[w]
+                                  | ((plus1[w] | minusN1[w]) & m_masks.notFirstCol[w])
+                                  | ((minus1[w] | plusN1[w]) & m_masks.notLastCol[w]);
+                    next &= stones[w];
+                    changed |= next != x[w];
+                    x[w] = next;
+                }
+            }
+            bool first = false, last = false;
+            for (unsigned w = 0; w < 4; w++) {
+                first |= (x[w] & m_masks.edge[color][0][w]) != 0;
+                last |= (x[w] & m_masks.edge[color][1][w]) != 0;
+            }
+            return first && last;
+        }
+#endif
+
+    public:
+        // true if the group of stones containing idx touches both edges of the color.
+        // stones is the bit-set of the color as returned by Board::stones.
+        static bool connectedThrough(uint64_t const* stones, unsigned color, unsigned idx) {
+            uint64_t own[4] = {0, 0, 0, 0};
+            uint64_t group[4] = {0, 0, 0, 0};
+            for (unsigned w = 0; w < WORDS; w++) {
+                own[w] = stones[w];
+            }
+            group[idx / 64] = uint64_t(1) << (idx % 64);
+            return m_grow(own, group, color);
+        }
+
+        // true if the color has connected its two edges
+        static bool connected(uint64_t const* stones, unsigned color) {
+            uint64_t own[4] = {0, 0, 0, 0};
+            uint64_t group[4] = {0, 0, 0, 0};
+            for (unsigned w = 0; w < WORDS; w++) {
+                own[w] = stones[w];
+                group[w] = stones[w] & m_masks.edge[color][0][w];
+            }
+            return m_grow(own, group, color);
+        }
+    };
+
+    template <unsigned N>
+    constexpr typename FloodFill<N>::Masks FloodFill<N>::m_masks;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HEX_HUMANPLAY_HPP
+#define HEX_HUMANPLAY_HPP
+
+#include "Hex.hpp"
+#include "hex_strategies.hpp"
+
+#include <iostream>
+#include <string>
+
+namespace Hex {
+
+    /*****************\
+     *  Human games  *
+    \*****************/
+    // The game loop of the play modes of hex and of hex_play. With for_python the boards and the
+    // result are printed in the protocol of playhex.py: "__MODEL_GOOD__" once the model is loaded,
+    // then the board size after the app answers, the boards as asciiStatePython and
+    // "__GAME_OVER__ 0" if blue won or "__GAME_OVER__ 1" if red did.
+
+    // the handshake with playhex.py, after the model was loaded
+    inline void initializePythonSettings(unsigned board_size) {
+        std::cout << "__MODEL_GOOD__" << std::endl;
+        std::string response = "";
+        std::getline(std::cin, response);
+        std::cout << "__BOARD_SIZE__ " << board_size << std::endl;
+    }
+
+    // Plays a game of a program as blue against a human as red. choose_move(game) returns the cell
+    // the program plays for the active player of the game.
+    template <unsigned N, class ChooseMove>
+    void playAgainstHuman(bool for_python, ChooseMove&& choose_move) {
+        HumanStrategy<N> human_player(for_python);
+        Game<N> game;
+        game.reset();
+        if (for_python) {
+            initializePythonSettings(N);
+            std::cout << game.asciiStatePython() << std::endl;
+        } else {
+            std::cout << game.asciiState() << std::endl;
+        }
+
+        bool won = false;
+        while (!won) {
+            if (game.ActivePlayer() == Blue) {
+                won = !game.takeTurn(choose_move(game));
+            } else {
+                won = !game.takeStrategyTurn({NULL, &human_player});
+            }
+            std::cout << (for_python ? game.asciiStatePython() : game.asciiState()) << std::endl;
+        }
+        if (for_python) {
+            std::cout << game.asciiStatePython() << std::endl;
+            std::cout << "__GAME_OVER__ " << (game.getRank(0) == 0 ? 0 : 1) << std::endl;
+        } else {
+            std::cout << game.asciiState() << std::endl;
+            std::cout << "Game over. Player " << (game.getRank(0) == 0 ? 1 : 2) << " won!" << std::endl;
+        }
+    }
+}
+
+#endif
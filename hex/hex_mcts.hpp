@@ -0,0 +1,371 @@
+#ifndef HEX_MCTS_HPP
+#define HEX_MCTS_HPP
+
+#include "Hex.hpp"
+#include "hex_strategies.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Hex {
+
+    /**********\
+     *  MCTS  *
+    \**********/
+    // Search settings of MCTSStrategy. The search stops at whichever of the visit budget and the
+    // time per move comes first; 0 turns either off, but not both.
+    struct MCTSOptions {
+        unsigned visits = 20000;            // simulations per move
+        unsigned milliseconds = 0;          // time per move
+        unsigned threads = 0;               // worker threads, 0 for one per core
+        double exploration = 0.4;           // weight of the exploration term of UCB1
+        std::size_t max_nodes = 1 << 22;    // nodes of the tree at most, 24 bytes each
+    };
+
+    // what the last search of an MCTSStrategy did
+    struct MCTSStats {
+        std::size_t simulations = 0;
+        std::size_t nodes = 0;
+        unsigned threads = 0;
+        double seconds = 0;
+    };
+
+    // A node of the search tree, for the position after its move. The statistics are atomics that
+    // the threads update without locks. Values are summed as fixed point for the player who made
+    // the move, so a node is better for the player choosing among its siblings the higher its mean.
+    struct MCTSNode {
+        static constexpr int64_t ONE = int64_t(1) << 24;
+        enum : uint8_t { Leaf, Expanding, Expanded };
+
+        std::atomic<uint32_t> visits;
+        std::atomic<uint32_t> virtual_loss;     // searches below the node that have not backed up yet
+        std::atomic<int64_t> value;
+        std::atomic<uint8_t> state;
+        uint8_t move;
+        uint8_t num_children;                   // the children are only read once state is Expanded
+        bool terminal;                          // the move won the game
+        uint32_t first_child;
+    };
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "the node statistics must be lock-free");
+
+    // Monte Carlo tree search over one tree shared by all threads, with the value network of a TD
+    // model as evaluator. Expanding a node values every move from it with one accumulator update,
+    // like TDNetworkStrategy::getMoveValues: the children start with that value as one visit, and the
+    // leaf backs up the value of its best move. A winning move becomes the only child of its node.
+    // Selection follows UCB1; a thread passing a node adds a virtual loss to it until it backs up,
+    // so the other threads spread over other lines instead of waiting for its result.
+    //
+    // The model is loaded and saved like a TD model. Leaves are always evaluated by the float32 or
+    // int8 inference engine, each thread on its own copy; precision Double evaluates in float32.
+    template <unsigned N>
+    class MCTSStrategy : public ReplayStrategy<N> {
+        struct Worker {
+            std::unique_ptr<Game<N>> game;      // a copy of the searched game, Game is not assignable
+            MLPInference inference;
+            BoardAccumulator<N> accumulator;
+        };
+
+        TDNetworkStrategy<N> m_evaluator;
+        MCTSOptions m_options;
+        MCTSStats m_stats;
+
+        std::unique_ptr<MCTSNode[]> m_nodes;
+        std::size_t m_capacity = 0;
+        std::atomic<std::size_t> m_used;
+        std::atomic<std::size_t> m_simulations;
+        std::atomic<bool> m_stop;
+
+        std::vector<Worker> m_workers;
+        bool m_workers_stale = true;
+
+        // a node whose value counts as its first visit, the root starts without visits
+        static void m_init(MCTSNode& node, unsigned move, double value, bool terminal, uint32_t visits = 1) {
+            node.visits.store(visits, std::memory_order_relaxed);
+            node.virtual_loss.store(0, std::memory_order_relaxed);
+            node.value.store(int64_t(value * MCTSNode::ONE), std::memory_order_relaxed);
+            node.state.store(MCTSNode::Leaf, std::memory_order_relaxed);
+            node.move = move;
+            node.num_children = 0;
+            node.terminal = terminal;
+            node.first_child = 0;
+        }
+
+        // the child with the highest upper confidence bound, virtual losses counting as lost visits
+        MCTSNode* m_select(MCTSNode& node) const {
+            MCTSNode* children = &m_nodes[node.first_child];
+            double parent = node.visits.load(std::memory_order_relaxed) + node.virtual_loss.load(std::memory_order_relaxed);
+            double log_parent = std::log(std::max(parent, 1.0));
+            MCTSNode* best = children;
+            double best_score = -std::numeric_limits<double>::max();
+            for (unsigned k = 0; k < node.num_children; k++) {
+                MCTSNode& child = children[k];
+                double visits = child.visits.load(std::memory_order_relaxed) + child.virtual_loss.load(std::memory_order_relaxed);
+                double mean = double(child.value.load(std::memory_order_relaxed)) / MCTSNode::ONE / visits;
+                double score = mean + m_options.exploration * std::sqrt(log_parent / visits);
+                if (score > best_score) {
+                    best_score = score;
+                    best = &child;
+                }
+            }
+            return best;
+        }
+
+        // Values the moves of the position of the worker's game and, if the tree has room, adds them
+        // as the children of node, which this thread holds as Expanding. Returns the value of the
+        // position for the player to move.
+        double m_expand(MCTSNode& node, Worker& worker) {
+            Game<N>& game = *worker.game;
+            unsigned player = game.ActivePlayer();
+            unsigned moves[N*N];
+            double values[N*N];
+            unsigned count = 0;
+            bool terminal = false;
+            for (unsigned k = 0; k < game.numEmptyCells() && !terminal; k++) {
+                unsigned move = game.emptyCell(k);
+                if (game.makeMove(move)) {
+                    moves[count] = move;
+                    values[count++] = 1.0;
+                    terminal = true;
+                }
+                game.unmakeMove();
+            }
+            if (!terminal) {
+                // the afterstates are valued by the opponent, like in TDNetworkStrategy
+                worker.accumulator.update(worker.inference, game.getBoard());
+                for (unsigned k = 0; k < game.numEmptyCells(); k++) {
+                    moves[count] = game.emptyCell(k);
+                    values[count++] = 1 - worker.accumulator.evalAfterstate(worker.inference, 1 - player, player, moves[k])[0];
+                }
+            }
+            // getChosenMove does not search finished games and a full board always has a winner, so
+            // there are moves; a worker thread cannot throw, it leaves the node a leaf otherwise
+            if (count == 0) {
+                node.state.store(MCTSNode::Leaf, std::memory_order_release);
+                return 0.5;
+            }
+            double best = *std::max_element(values, values + count);
+
+            std::size_t first = m_used.fetch_add(count, std::memory_order_relaxed);
+            if (first + count > m_capacity) {
+                node.state.store(MCTSNode::Leaf, std::memory_order_release);
+                return best;
+            }
+            for (unsigned k = 0; k < count; k++) {
+                m_init(m_nodes[first + k], moves[k], values[k], terminal);
+            }
+            node.first_child = first;
+            node.num_children = count;
+            node.state.store(MCTSNode::Expanded, std::memory_order_release);
+            return best;
+        }
+
+        // one simulation from the root: select down to a leaf, evaluate or expand it, back up
+        void m_simulate(Worker& worker) {
+            Game<N>& game = *worker.game;
+            MCTSNode* path[N*N + 1];
+            unsigned depth = 0;
+            MCTSNode* node = &m_nodes[0];
+            path[depth++] = node;
+            double value;   // for the player to move after the last node of the path
+            while (true) {
+                if (node->terminal) {
+                    value = 0.0;
+                    break;
+                }
+                uint8_t state = node->state.load(std::memory_order_acquire);
+                if (state == MCTSNode::Expanded) {
+                    node = m_select(*node);
+                    node->virtual_loss.fetch_add(1, std::memory_order_relaxed);
+                    game.makeMove(node->move);
+                    path[depth++] = node;
+                    continue;
+                }
+                uint8_t leaf = MCTSNode::Leaf;
+                if (state == MCTSNode::Leaf && node->state.compare_exchange_strong(leaf, MCTSNode::Expanding,
+                                                                                    std::memory_order_acquire)) {
+                    value = m_expand(*node, worker);
+                } else {
+                    // another thread is expanding the node, the network alone values it meanwhile
+                    worker.accumulator.update(worker.inference, game.getBoard());
+                    value = worker.accumulator.eval(worker.inference, game.ActivePlayer())[0];
+                }
+                break;
+            }
+            while (depth > 0) {
+                MCTSNode* backed = path[--depth];
+                value = 1 - value;
+                backed->value.fetch_add(int64_t(value * MCTSNode::ONE), std::memory_order_relaxed);
+                backed->visits.fetch_add(1, std::memory_order_relaxed);
+                if (depth > 0) {
+                    backed->virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+                    game.unmakeMove();
+                }
+            }
+        }
+
+        // simulates until the visit budget is used up or the deadline passed
+        void m_search(Worker& worker, std::chrono::steady_clock::time_point deadline) {
+            while (!m_stop.load(std::memory_order_relaxed)) {
+                std::size_t k = m_simulations.fetch_add(1, std::memory_order_relaxed);
+                if (m_options.visits && k >= m_options.visits) {
+                    break;
+                }
+                if (m_options.milliseconds && k % 32 == 0 && std::chrono::steady_clock::now() >= deadline) {
+                    m_stop.store(true, std::memory_order_relaxed);
+                    break;
+                }
+                m_simulate(worker);
+            }
+        }
+
+        unsigned m_threads() const {
+            unsigned threads = m_options.threads ? m_options.threads : std::thread::hardware_concurrency();
+            return std::max(threads, 1u);
+        }
+
+        // getMoveAction plays the searched move
+        unsigned chooseReplayMove(Game<N>& game) override {
+            return getChosenMove(game).second;
+        }
+
+    public:
+        MCTSStrategy() : m_used(0), m_simulations(0), m_stop(false) {}
+
+        MCTSStrategy(MCTSStrategy const&) = delete;
+        MCTSStrategy& operator=(MCTSStrategy const&) = delete;
+
+        void setOptions(MCTSOptions const& options) {
+            if (options.visits == 0 && options.milliseconds == 0) {
+                throw std::invalid_argument("MCTSStrategy: the search needs a visit budget or a time per move");
+            }
+            m_options = options;
+        }
+
+        MCTSOptions const& options() const { return m_options; }
+
+        MCTSStats const& lastSearch() const { return m_stats; }
+
+        TDNetworkStrategy<N> const& evaluator() const { return m_evaluator; }
+
+        void setPrecision(Precision precision) {
+            m_evaluator.setPrecision(precision);
+            m_workers_stale = true;
+        }
+
+        Precision precision() const {
+            return m_evaluator.precision();
+        }
+
+        // Searches the position of the game for its active player and returns the most visited move
+        // with its mean value. The game is left as it was and must not be finished.
+        std::pair<double, int> getChosenMove(Game<N>& game) {
+            if (game.finished()) {
+                throw std::invalid_argument("MCTSStrategy: the game is finished, there is no move to search");
+            }
+            std::pair<double, int> book_move;
+            if (this->bookMove(game.getBoard(), game.ActivePlayer(), book_move)) {
+                return book_move;
+            }
+            auto start_time = std::chrono::steady_clock::now();
+            unsigned threads = m_threads();
+            if (m_workers.size() != threads) {
+                m_workers.resize(threads);
+                m_workers_stale = true;
+            }
+            if (m_workers_stale) {
+                for (Worker& worker : m_workers) {
+                    worker.inference = m_evaluator.inference();
+                    worker.accumulator.reset(worker.inference);
+                }
+                m_workers_stale = false;
+            }
+            for (Worker& worker : m_workers) {
+                worker.game.reset(new Game<N>(game));
+                worker.game->setRecorder(nullptr);
+            }
+
+            // every simulation expands at most one node
+            std::size_t capacity = m_options.max_nodes;
+            if (m_options.visits) {
+                capacity = std::min(capacity, std::size_t(m_options.visits) * game.numEmptyCells() + 1);
+            }
+            capacity = std::max(capacity, std::size_t(game.numEmptyCells()) + 1);
+            if (capacity > m_capacity) {
+                m_nodes.reset(new MCTSNode[capacity]);
+                m_capacity = capacity;
+            }
+            m_init(m_nodes[0], 0, 0.0, false, 0);
+            m_used.store(1);
+            m_stop.store(false);
+
+            // the first simulation expands the root, the threads then share the tree
+            m_simulate(m_workers[0]);
+            m_simulations.store(1);
+            MCTSNode& root = m_nodes[0];
+            if (root.num_children > 1) {
+                auto deadline = start_time + std::chrono::milliseconds(m_options.milliseconds);
+                std::vector<std::thread> helpers;
+                for (unsigned t = 1; t < threads; t++) {
+                    helpers.emplace_back([this, t, deadline]() { m_search(m_workers[t], deadline); });
+                }
+                m_search(m_workers[0], deadline);
+                for (std::thread& helper : helpers) {
+                    helper.join();
+                }
+            }
+
+            m_stats.simulations = root.visits.load();
+            m_stats.nodes = std::min(m_used.load(), m_capacity);
+            m_stats.threads = threads;
+            m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+            // most visits, the higher mean among equals
+            MCTSNode* children = &m_nodes[root.first_child];
+            MCTSNode* best = children;
+            for (unsigned k = 1; k < root.num_children; k++) {
+                MCTSNode& child = children[k];
+                uint32_t visits = child.visits.load(), best_visits = best->visits.load();
+                if (visits > best_visits || (visits == best_visits && child.value.load() > best->value.load())) {
+                    best = &child;
+                }
+            }
+            return std::pair<double, int>(double(best->value.load()) / MCTSNode::ONE / best->visits.load(), best->move);
+        }
+
+        std::size_t numParameters() const override {
+            return m_evaluator.numParameters();
+        }
+
+        void setParameters(ParameterSpan parameters) override {
+            m_evaluator.setParameters(parameters);
+            m_workers_stale = true;
+        }
+
+        ConcatenatedModel<RealVector>& GetMoveModel() override {
+            return m_evaluator.GetMoveModel();
+        }
+
+        void modelLoaded(std::shared_ptr<float const> const& inference_weights) override {
+            m_evaluator.modelLoaded(inference_weights);
+            m_workers_stale = true;
+        }
+
+        std::vector<LayerShape> layerShapes() const override {
+            return m_evaluator.layerShapes();
+        }
+
+        int type() override {
+            return 5;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,558 @@
+#ifndef HEX_MLP_HPP
+#define HEX_MLP_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace Hex {
+
+    /*******************\
+     *  MLP inference  *
+    \*******************/
+    // Forward pass of the small dense networks of the strategies, without Shark. The weights are
+    // float32 and stored per layer transposed, [input][output] with the outputs padded to a multiple
+    // of 8, so a layer is a sum of input-scaled weight rows: 8 outputs per FMA, with the offset and
+    // a rectifier fused in. The activations live in two scratch buffers allocated with the layers,
+    // so an evaluation does not allocate. Like the strategies, one object is used by one thread.
+    // The weights are either a copy of its own or, see mapWeights, shared with its copies and with
+    // other processes through the mapping of a model file that stores them in this layout.
+    // the values are stored in model files, see hex_model.hpp
+    enum class Activation {
+        Linear = 0,
+        Rectifier = 1,
+        Logistic = 2
+    };
+
+    // shape of a dense layer, as passed to MLPInference::addLayer
+    struct LayerShape {
+        unsigned inputs;
+        unsigned outputs;
+        Activation activation;
+        bool offset;
+
+        bool operator==(LayerShape const& other) const {
+            return inputs == other.inputs && outputs == other.outputs
+                && activation == other.activation && offset == other.offset;
+        }
+        bool operator!=(LayerShape const& other) const { return !(*this == other); }
+    };
+
+    // Arithmetic a strategy plays with. Double is the Shark network itself, the strategies only use
+    // MLPInference for Float32 and Int8. With Int8 every layer whose inputs cannot be negative (the
+    // layers after a rectifier or logistic layer) multiplies int8 weights, scaled per layer, with its
+    // inputs quantized to 0..127 per evaluation, accumulating in int32 with VNNI or AVX2 dot products.
+    // The first layer stays float: its inputs are signed and it only gathers the rows of the stones.
+    enum class Precision {
+        Double,
+        Float32,
+        Int8
+    };
+
+    // Vector types that store their elements as consecutive doubles and can be viewed by a
+    // ParameterSpan. Hex.hpp adds Shark's RealVector. Proxies such as matrix columns or subranges
+    // of them are strided and must not be viewed.
+    template <class Vector>
+    struct IsDenseVector : std::false_type {};
+
+    // Non-owning view of consecutive parameters, like a parameter vector or the part of an ES search
+    // point that belongs to one player. Setting parameters from a span reads them in place, the
+    // viewed vector has to outlive the call only.
+    class ParameterSpan {
+        double const* m_data;
+        std::size_t m_size;
+
+    public:
+        ParameterSpan(double const* data, std::size_t size) : m_data(data), m_size(size) {}
+
+        // a dense vector, see IsDenseVector
+        template <class Vector, class = typename std::enable_if<IsDenseVector<Vector>::value>::type>
+        ParameterSpan(Vector const& vector) : m_data(vector.size() ? &vector(0) : nullptr), m_size(vector.size()) {}
+
+        std::size_t size() const { return m_size; }
+        double const* data() const { return m_data; }
+        double operator()(std::size_t k) const { return m_data[k]; }
+
+        ParameterSpan subspan(std::size_t offset, std::size_t size) const {
+            if (offset > m_size || size > m_size - offset) {
+                throw std::invalid_argument("ParameterSpan: the subspan is out of range");
+            }
+            return ParameterSpan(m_data + offset, size);
+        }
+    };
+
+    class MLPInference {
+        struct Layer {
+            unsigned inputs;
+            unsigned outputs;
+            unsigned padded;        // outputs rounded up to a multiple of 8
+            Activation activation;
+            bool offset;
+            std::size_t weights;    // position of the transposed weights in layout()
+            std::size_t offsets;    // position of the padded offsets in layout()
+            bool quantized;         // evaluated with m_quantized when the precision is Int8
+            std::size_t qweights;   // position of the int8 weights in m_quantized
+            float scale;            // of the int8 weights
+        };
+
+        std::vector<Layer> m_layers;
+        std::vector<float> m_weights;
+        std::shared_ptr<float const> m_mapped;     // the weights instead of m_weights, see mapWeights
+        mutable std::vector<float> m_scratch[2];
+
+        Precision m_precision = Precision::Float32;
+        // int8 weights in groups of 4 consecutive inputs, [input / 4][output][input % 4], so one 32 byte
+        // load holds 4 inputs of 8 outputs, the operand layout of the dot product instructions
+        std::vector<int8_t> m_quantized;
+        mutable std::vector<uint8_t> m_qinputs;
+
+        // the weights in use, in the layout of layout()
+        float const* m_data() const { return m_mapped ? m_mapped.get() : m_weights.data(); }
+
+        // the 4 byte groups of a layer
+        static unsigned m_groups(Layer const& layer) { return (layer.inputs + 3) / 4; }
+
+        // weights of every quantized layer as int8, with the largest magnitude of the layer mapped to 127
+        void m_quantize() {
+            m_quantized.clear();
+            for (Layer& layer : m_layers) {
+                if (!layer.quantized) { continue; }
+                float const* weights = m_data() + layer.weights;
+                float max_weight = 0.0f;
+                for (std::size_t k = 0; k < std::size_t(layer.inputs) * layer.padded; k++) {
+                    max_weight = std::max(max_weight, std::abs(weights[k]));
+                }
+                layer.scale = (max_weight > 0.0f ? max_weight / 127.0f : 1.0f);
+                layer.qweights = m_quantized.size();
+                m_quantized.resize(m_quantized.size() + std::size_t(m_groups(layer)) * layer.padded * 4, 0);
+                int8_t* q = m_quantized.data() + layer.qweights;
+                for (unsigned i = 0; i < layer.inputs; i++) {
+                    for (unsigned o = 0; o < layer.padded; o++) {
+                        float w = std::round(weights[std::size_t(i) * layer.padded + o] / layer.scale);
+                        q[(std::size_t(i / 4) * layer.padded + o) * 4 + i % 4] = int8_t(std::max(-127.0f, std::min(127.0f, w)));
+                    }
+                }
+            }
+        }
+
+#if defined(__AVX2__)
+        // acc[o] += sum of the 4 products of the unsigned bytes of x and the signed bytes of w in lane o
+        static __m256i m_dot4(__m256i acc, __m256i x, __m256i w) {
+#if defined(__AVXVNNI__)
+            return _mm256_dpbusd_avx_epi32(acc, x, w);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+            return _mm256_dpbusd_epi32(acc, x, w);
+#else
+            // inputs are at most 127, so the pairwise 16 bit sums of maddubs cannot saturate
+            __m256i pairs = _mm256_maddubs_epi16(x, w);
+            return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+#endif
+        }
+#endif
+
+        // the layer with int8 weights, in holds its non negative inputs
+        void m_layer_int8(Layer const& layer, float const* in, float* out) const {
+            float const* offsets = m_data() + layer.offsets;
+            float max_input = 0.0f;
+            for (unsigned i = 0; i < layer.inputs; i++) {
+                max_input = std::max(max_input, in[i]);
+            }
+            if (max_input == 0.0f) {
+                std::copy(offsets, offsets + layer.padded, out);
+                m_activate(layer, out);
+                return;
+            }
+            uint8_t* q = m_qinputs.data();
+            float to_int = 127.0f / max_input;
+            for (unsigned i = 0; i < layer.inputs; i++) {
+                q[i] = uint8_t(in[i] * to_int + 0.5f);
+            }
+            for (unsigned i = layer.inputs; i < 4 * m_groups(layer); i++) {
+                q[i] = 0;
+            }
+            float scale = layer.scale / to_int;
+            int8_t const* weights = m_quantized.data() + layer.qweights;
+            unsigned o = 0;
+#if defined(__AVX2__)
+            for (; o < layer.padded; o += 8) {
+                __m256i acc = _mm256_setzero_si256();
+                int8_t const* w = weights + o * 4;
+                for (unsigned g = 0; g < m_groups(layer); g++, w += layer.padded * 4) {
+                    int32_t x;
+                    std::memcpy(&x, q + 4 * g, 4);
+                    acc = m_dot4(acc, _mm256_set1_epi32(x), _mm256_loadu_si256(reinterpret_cast<__m256i const*>(w)));
+                }
+                __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc), _mm256_set1_ps(scale)), _mm256_loadu_ps(offsets + o));
+                _mm256_storeu_ps(out + o, y);
+            }
+#else
+            for (; o < layer.padded; o++) {
+                int32_t acc = 0;
+                for (unsigned i = 0; i < layer.inputs; i++) {
+                    acc += int32_t(q[i]) * weights[(std::size_t(i / 4) * layer.padded + o) * 4 + i % 4];
+                }
+                out[o] = acc * scale + offsets[o];
+            }
+#endif
+            m_activate(layer, out);
+        }
+
+        // out[0..padded) = activation(offsets + sum_i in[i] * weights[i])
+        static void m_layer(Layer const& layer, float const* weights, float const* in, float* out) {
+            float const* offsets = weights + (layer.offsets - layer.weights);
+            std::size_t o = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+            // four output blocks at a time keep four independent FMA chains in flight
+            for (; o + 32 <= layer.padded; o += 32) {
+                __m256 acc0 = _mm256_loadu_ps(offsets + o);
+                __m256 acc1 = _mm256_loadu_ps(offsets + o + 8);
+                __m256 acc2 = _mm256_loadu_ps(offsets + o + 16);
+                __m256 acc3 = _mm256_loadu_ps(offsets + o + 24);
+                float const* w = weights + o;
+                for (unsigned i = 0; i < layer.inputs; i++, w += layer.padded) {
+                    __m256 x = _mm256_set1_ps(in[i]);
+                    acc0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(w), acc0);
+                    acc1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(w + 8), acc1);
+                    acc2 = _mm256_fmadd_ps(x, _mm256_loadu_ps(w + 16), acc2);
+                    acc3 = _mm256_fmadd_ps(x, _mm256_loadu_ps(w + 24), acc3);
+                }
+                if (layer.activation == Activation::Rectifier) {
+                    __m256 zero = _mm256_setzero_ps();
+                    acc0 = _mm256_max_ps(acc0, zero);
+                    acc1 = _mm256_max_ps(acc1, zero);
+                    acc2 = _mm256_max_ps(acc2, zero);
+                    acc3 = _mm256_max_ps(acc3, zero);
+                }
+                _mm256_storeu_ps(out + o, acc0);
+                _mm256_storeu_ps(out + o + 8, acc1);
+                _mm256_storeu_ps(out + o + 16, acc2);
+                _mm256_storeu_ps(out + o + 24, acc3);
+            }
+            for (; o < layer.padded; o += 8) {
+                __m256 acc = _mm256_loadu_ps(offsets + o);
+                float const* w = weights + o;
+                for (unsigned i = 0; i < layer.inputs; i++, w += layer.padded) {
+                    acc = _mm256_fmadd_ps(_mm256_set1_ps(in[i]), _mm256_loadu_ps(w), acc);
+                }
+                if (layer.activation == Activation::Rectifier) {
+                    acc = _mm256_max_ps(acc, _mm256_setzero_ps());
+                }
+                _mm256_storeu_ps(out + o, acc);
+            }
+#else
+            for (; o < layer.padded; o++) {
+                out[o] = offsets[o];
+            }
+            float const* w = weights;
+            for (unsigned i = 0; i < layer.inputs; i++, w += layer.padded) {
+                for (o = 0; o < layer.padded; o++) {
+                    out[o] += in[i] * w[o];
+                }
+            }
+            if (layer.activation == Activation::Rectifier) {
+                m_activate(layer, out);
+            }
+#endif
+            // the logistic is only used on single value outputs, where a vector exp does not pay off
+            if (layer.activation == Activation::Logistic) {
+                m_activate(layer, out);
+            }
+        }
+
+        // out[0..padded) = activation(offsets + sum of the weight rows of plus - sum of those of minus),
+        // the first layer for inputs that are 1 at plus, -1 at minus and 0 everywhere else
+        static void m_layer_sparse(Layer const& layer, float const* weights, unsigned const* plus, unsigned num_plus,
+                                   unsigned const* minus, unsigned num_minus, float* out) {
+            float const* offsets = weights + (layer.offsets - layer.weights);
+            std::size_t o = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+            for (; o + 32 <= layer.padded; o += 32) {
+                __m256 acc0 = _mm256_loadu_ps(offsets + o);
+                __m256 acc1 = _mm256_loadu_ps(offsets + o + 8);
+                __m256 acc2 = _mm256_loadu_ps(offsets + o + 16);
+                __m256 acc3 = _mm256_loadu_ps(offsets + o + 24);
+                for (unsigned k = 0; k < num_plus; k++) {
+                    float const* w = weights + std::size_t(plus[k]) * layer.padded + o;
+                    acc0 = _mm256_add_ps(acc0, _mm256_loadu_ps(w));
+                    acc1 = _mm256_add_ps(acc1, _mm256_loadu_ps(w + 8));
+                    acc2 = _mm256_add_ps(acc2, _mm256_loadu_ps(w + 16));
+                    acc3 = _mm256_add_ps(acc3, _mm256_loadu_ps(w + 24));
+                }
+                for (unsigned k = 0; k < num_minus; k++) {
+                    float const* w = weights + std::size_t(minus[k]) * layer.padded + o;
+                    acc0 = _mm256_sub_ps(acc0, _mm256_loadu_ps(w));
+                    acc1 = _mm256_sub_ps(acc1, _mm256_loadu_ps(w + 8));
+                    acc2 = _mm256_sub_ps(acc2, _mm256_loadu_ps(w + 16));
+                    acc3 = _mm256_sub_ps(acc3, _mm256_loadu_ps(w + 24));
+                }
+                _mm256_storeu_ps(out + o, acc0);
+                _mm256_storeu_ps(out + o + 8, acc1);
+                _mm256_storeu_ps(out + o + 16, acc2);
+                _mm256_storeu_ps(out + o + 24, acc3);
+            }
+            for (; o < layer.padded; o += 8) {
+                __m256 acc = _mm256_loadu_ps(offsets + o);
+                for (unsigned k = 0; k < num_plus; k++) {
+                    acc = _mm256_add_ps(acc, _mm256_loadu_ps(weights + std::size_t(plus[k]) * layer.padded + o));
+                }
+                for (unsigned k = 0; k < num_minus; k++) {
+                    acc = _mm256_sub_ps(acc, _mm256_loadu_ps(weights + std::size_t(minus[k]) * layer.padded + o));
+                }
+                _mm256_storeu_ps(out + o, acc);
+            }
+#else
+            for (; o < layer.padded; o++) {
+                out[o] = offsets[o];
+            }
+            for (unsigned k = 0; k < num_plus; k++) {
+                float const* w = weights + std::size_t(plus[k]) * layer.padded;
+                for (o = 0; o < layer.padded; o++) {
+                    out[o] += w[o];
+                }
+            }
+            for (unsigned k = 0; k < num_minus; k++) {
+                float const* w = weights + std::size_t(minus[k]) * layer.padded;
+                for (o = 0; o < layer.padded; o++) {
+                    out[o] -= w[o];
+                }
+            }
+#endif
+            m_activate(layer, out);
+        }
+
+        // applies the activation of the layer to its padded outputs
+        static void m_activate(Layer const& layer, float* out) {
+            if (layer.activation == Activation::Rectifier) {
+                for (unsigned o = 0; o < layer.padded; o++) {
+                    out[o] = std::max(out[o], 0.0f);
+                }
+            } else if (layer.activation == Activation::Logistic) {
+                for (unsigned o = 0; o < layer.outputs; o++) {
+                    out[o] = 1.0f / (1.0f + std::exp(-out[o]));
+                }
+            }
+        }
+
+        // y[0..n) += a * x[0..n), n a multiple of 8
+        static void m_axpy(float a, float const* x, float* y, unsigned n) {
+            unsigned o = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+            __m256 a8 = _mm256_set1_ps(a);
+            for (; o < n; o += 8) {
+                _mm256_storeu_ps(y + o, _mm256_fmadd_ps(a8, _mm256_loadu_ps(x + o), _mm256_loadu_ps(y + o)));
+            }
+#endif
+            for (; o < n; o++) {
+                y[o] += a * x[o];
+            }
+        }
+
+        // evaluates the layers from first on, in holds the input of layer first
+        float const* m_eval_from(std::size_t first, float const* in) const {
+            for (std::size_t l = first; l < m_layers.size(); l++) {
+                float* out = m_scratch[l % 2].data();
+                if (m_precision == Precision::Int8 && m_layers[l].quantized) {
+                    m_layer_int8(m_layers[l], in, out);
+                } else {
+                    m_layer(m_layers[l], m_data() + m_layers[l].weights, in, out);
+                }
+                in = out;
+            }
+            return in;
+        }
+
+    public:
+        // appends a dense layer, laid out like a Shark LinearModel set up with setStructure(inputs, outputs, offset)
+        void addLayer(unsigned inputs, unsigned outputs, Activation activation, bool offset = false) {
+            if (!m_layers.empty() && m_layers.back().outputs != inputs) {
+                throw std::invalid_argument("MLPInference: layer inputs do not match the previous layer");
+            }
+            if (m_mapped) {
+                throw std::logic_error("MLPInference: layers cannot be added to mapped weights");
+            }
+            Layer layer;
+            layer.inputs = inputs;
+            layer.outputs = outputs;
+            layer.padded = (outputs + 7) / 8 * 8;
+            layer.activation = activation;
+            layer.offset = offset;
+            layer.weights = m_weights.size();
+            layer.offsets = layer.weights + std::size_t(inputs) * layer.padded;
+            layer.quantized = !m_layers.empty() && m_layers.back().activation != Activation::Linear;
+            layer.qweights = 0;
+            layer.scale = 1.0f;
+            m_weights.resize(layer.offsets + layer.padded, 0.0f);
+            m_layers.push_back(layer);
+
+            unsigned width = 0;
+            for (Layer const& l : m_layers) {
+                width = std::max(width, std::max(l.inputs, l.padded));
+            }
+            m_scratch[0].assign(width, 0.0f);
+            m_scratch[1].assign(width, 0.0f);
+            m_qinputs.assign(width + 4, 0);
+            if (m_precision == Precision::Int8) { m_quantize(); }
+        }
+
+        // Double evaluates like Float32
+        void setPrecision(Precision precision) {
+            m_precision = precision;
+            if (m_precision == Precision::Int8) { m_quantize(); }
+        }
+
+        Precision precision() const { return m_precision; }
+
+        std::size_t numberOfParameters() const {
+            std::size_t n = 0;
+            for (Layer const& layer : m_layers) {
+                n += std::size_t(layer.inputs) * layer.outputs + (layer.offset ? layer.outputs : 0);
+            }
+            return n;
+        }
+
+        std::vector<LayerShape> shapes() const {
+            std::vector<LayerShape> shapes;
+            for (Layer const& layer : m_layers) {
+                shapes.push_back(LayerShape{layer.inputs, layer.outputs, layer.activation, layer.offset});
+            }
+            return shapes;
+        }
+
+        // Number of floats of the weights of layers of the given shapes in the layout MLPInference
+        // evaluates: per layer the weights transposed, [input][output] with the outputs padded to a
+        // multiple of 8, then the padded offsets (zeros if the layer has none). The padding is zero.
+        static std::size_t layoutSize(std::vector<LayerShape> const& shapes) {
+            std::size_t size = 0;
+            for (LayerShape const& shape : shapes) {
+                size += (std::size_t(shape.inputs) + 1) * ((shape.outputs + 7) / 8 * 8);
+            }
+            return size;
+        }
+
+        // the layoutSize(shapes()) floats of the weights in use, as model files store them
+        float const* layout() const { return m_data(); }
+
+        unsigned inputSize() const { return m_layers.front().inputs; }
+        unsigned outputSize() const { return m_layers.back().outputs; }
+
+        // Copies the weights from a parameter vector laid out like ConcatenatedModel::parameterVector():
+        // per layer the weight matrix (outputs x inputs) row by row, then the offsets if it has them.
+        template <class Parameters>
+        void setParameters(Parameters const& parameters) {
+            if (parameters.size() != numberOfParameters()) {
+                throw std::invalid_argument("MLPInference: wrong number of parameters");
+            }
+            if (m_mapped) {
+                m_mapped.reset();
+                m_weights.assign(layoutSize(shapes()), 0.0f);
+            }
+            std::size_t p = 0;
+            for (Layer const& layer : m_layers) {
+                float* weights = m_weights.data() + layer.weights;
+                for (unsigned o = 0; o < layer.outputs; o++) {
+                    for (unsigned i = 0; i < layer.inputs; i++) {
+                        weights[std::size_t(i) * layer.padded + o] = float(parameters(p++));
+                    }
+                }
+                if (layer.offset) {
+                    for (unsigned o = 0; o < layer.outputs; o++) {
+                        m_weights[layer.offsets + o] = float(parameters(p++));
+                    }
+                }
+            }
+            if (m_precision == Precision::Int8) { m_quantize(); }
+        }
+
+        // Evaluates from layoutSize(shapes()) floats in the layout of layout() instead of a copy, like
+        // the weights of a mapped model file. They are not copied: copies of the inference share them
+        // and they must not change while in use. setParameters goes back to a copy of its own. The
+        // int8 weights of Int8 precision are still quantized into a copy.
+        void mapWeights(std::shared_ptr<float const> weights) {
+            if (!weights) {
+                throw std::invalid_argument("MLPInference: no weights to map");
+            }
+            m_mapped = std::move(weights);
+            std::vector<float>().swap(m_weights);
+            if (m_precision == Precision::Int8) { m_quantize(); }
+        }
+
+        // the parameters, read in place from weights in the layout of layout() if there are any
+        template <class Parameters>
+        void setParameters(Parameters const& parameters, std::shared_ptr<float const> weights) {
+            if (weights) {
+                mapWeights(std::move(weights));
+            } else {
+                setParameters(parameters);
+            }
+        }
+
+        // evaluates the network on inputSize() inputs. The result holds outputSize() values and stays
+        // valid until the next evaluation.
+        float const* eval(float const* input) const {
+            return m_eval_from(0, input);
+        }
+
+        // evaluates the network on inputs that are 1 at the indices in plus, -1 at those in minus and 0
+        // everywhere else, like the encoded boards: the first layer only gathers the rows of the stones
+        float const* evalSparse(unsigned const* plus, unsigned num_plus, unsigned const* minus, unsigned num_minus) const {
+            Layer const& layer = m_layers.front();
+            float* out = m_scratch[0].data();
+            m_layer_sparse(layer, m_data() + layer.weights, plus, num_plus, minus, num_minus, out);
+            return m_eval_from(1, out);
+        }
+
+        // Accumulators hold the pre-activations of the first layer, accumulatorSize() floats. A network
+        // whose inputs change in few places between evaluations can keep an accumulator up to date by
+        // adding the weights of the changed inputs, instead of multiplying all inputs by the first layer.
+        unsigned accumulatorSize() const { return m_layers.front().padded; }
+
+        // the accumulator of the all zero input: the offsets of the first layer
+        void initAccumulator(float* accumulator) const {
+            Layer const& layer = m_layers.front();
+            std::copy(m_data() + layer.offsets, m_data() + layer.offsets + layer.padded, accumulator);
+        }
+
+        // changes the accumulator for input by delta
+        void accumulate(float* accumulator, unsigned input, float delta) const {
+            Layer const& layer = m_layers.front();
+            m_axpy(delta, m_data() + layer.weights + std::size_t(input) * layer.padded, accumulator, layer.padded);
+        }
+
+        // evaluates the network from an accumulator with input changed by delta, leaving the accumulator as it is
+        float const* evalAccumulated(float const* accumulator, unsigned input, float delta) const {
+            Layer const& layer = m_layers.front();
+            float* out = m_scratch[0].data();
+            std::copy(accumulator, accumulator + layer.padded, out);
+            m_axpy(delta, m_data() + layer.weights + std::size_t(input) * layer.padded, out, layer.padded);
+            m_activate(layer, out);
+            return m_eval_from(1, out);
+        }
+
+        float const* evalAccumulated(float const* accumulator) const {
+            Layer const& layer = m_layers.front();
+            float* out = m_scratch[0].data();
+            std::copy(accumulator, accumulator + layer.padded, out);
+            m_activate(layer, out);
+            return m_eval_from(1, out);
+        }
+
+        // evaluates rows inputs stored back to back, writing outputSize() values per row to outputs
+        void eval(float const* inputs, std::size_t rows, float* outputs) const {
+            for (std::size_t r = 0; r < rows; r++) {
+                float const* result = eval(inputs + r * inputSize());
+                std::copy(result, result + outputSize(), outputs + r * outputSize());
+            }
+        }
+    };
+}
+
+#endif
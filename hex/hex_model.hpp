@@ -0,0 +1,253 @@
+#ifndef HEX_MODEL_HPP
+#define HEX_MODEL_HPP
+
+#include "hex_mlp.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Hex {
+
+    /*****************\
+     *  Model files  *
+    \*****************/
+    // Binary models. A file starts with a ModelFileHeader, followed by one ModelFileLayer per layer
+    // and, at dataOffset (a multiple of 64), the parameters as float or double, laid out like
+    // ConcatenatedModel::parameterVector(). From version 2 on the float32 weights of MLPInference
+    // follow at the next multiple of 64, in the padded and transposed layout it evaluates (see
+    // MLPInference::layoutSize). All fields are little endian and fixed size, so a file is read in
+    // place through a read-only mapping, without parsing. The checksum is the 64 bit FNV-1a hash of
+    // everything after the header.
+    //
+    // The strategies copy the parameters into their Shark network, which trains and plays Double,
+    // and evaluate Float32 straight from the mapped inference weights: processes playing the same
+    // model share those pages. Version 1 files have no inference weights, they are copied as well.
+    struct ModelFileHeader {
+        char magic[4];          // "HXMD"
+        uint32_t version;
+        uint32_t numLayers;
+        uint32_t scalarSize;    // 4 for float, 8 for double parameters
+        uint64_t numParameters;
+        uint64_t dataOffset;
+        uint64_t checksum;
+    };
+
+    struct ModelFileLayer {
+        uint32_t inputs;
+        uint32_t outputs;
+        uint8_t activation;     // an Activation
+        uint8_t offset;
+        uint16_t reserved;
+        uint32_t reserved2;
+    };
+
+    static_assert(sizeof(ModelFileHeader) == 40, "model file header must be packed");
+    static_assert(sizeof(ModelFileLayer) == 16, "model file layer must be packed");
+
+    static const char MODEL_FILE_MAGIC[4] = {'H', 'X', 'M', 'D'};
+    static const uint32_t MODEL_FILE_VERSION = 2;
+
+    // where the inference weights start, after the parameters
+    inline uint64_t modelInferenceOffset(ModelFileHeader const& header) {
+        return (header.dataOffset + header.numParameters * header.scalarSize + 63) / 64 * 64;
+    }
+
+    inline uint64_t modelChecksum(uint8_t const* data, std::size_t size, uint64_t hash = 14695981039346656037ull) {
+        for (std::size_t k = 0; k < size; k++) {
+            hash = (hash ^ data[k]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // whether the file is a binary model, the text archives of Shark are not
+    inline bool isModelFile(std::string const& path) {
+        char magic[4] = {0, 0, 0, 0};
+        std::ifstream in(path, std::ios::binary);
+        in.read(magic, 4);
+        return in && std::memcmp(magic, MODEL_FILE_MAGIC, 4) == 0;
+    }
+
+    // Writes the parameters (anything with size() and operator()) of a network of the given layers.
+    // The file is written next to path and renamed over it, so a process mapping the old file keeps
+    // reading the old model.
+    template <class Parameters>
+    void writeModelFile(std::string const& path, std::vector<LayerShape> const& shapes, Parameters const& parameters,
+                        bool as_float = false) {
+        std::size_t count = 0;
+        for (LayerShape const& shape : shapes) {
+            count += std::size_t(shape.inputs) * shape.outputs + (shape.offset ? shape.outputs : 0);
+        }
+        if (count != std::size_t(parameters.size())) {
+            throw std::invalid_argument("writeModelFile: the parameters do not match the layers");
+        }
+
+        ModelFileHeader header;
+        std::memcpy(header.magic, MODEL_FILE_MAGIC, 4);
+        header.version = MODEL_FILE_VERSION;
+        header.numLayers = shapes.size();
+        header.scalarSize = (as_float ? 4 : 8);
+        header.numParameters = count;
+        header.dataOffset = (sizeof(ModelFileHeader) + shapes.size() * sizeof(ModelFileLayer) + 63) / 64 * 64;
+
+        MLPInference inference;
+        for (LayerShape const& shape : shapes) {
+            inference.addLayer(shape.inputs, shape.outputs, shape.activation, shape.offset);
+        }
+        inference.setParameters(parameters);
+        std::size_t layout_size = MLPInference::layoutSize(shapes);
+        uint64_t inference_offset = modelInferenceOffset(header);
+
+        std::vector<uint8_t> body(inference_offset - sizeof(ModelFileHeader) + layout_size * 4, 0);
+        ModelFileLayer* layers = reinterpret_cast<ModelFileLayer*>(body.data());
+        for (std::size_t l = 0; l < shapes.size(); l++) {
+            layers[l] = ModelFileLayer{shapes[l].inputs, shapes[l].outputs, uint8_t(shapes[l].activation),
+                                       uint8_t(shapes[l].offset), 0, 0};
+        }
+        uint8_t* data = body.data() + header.dataOffset - sizeof(ModelFileHeader);
+        for (std::size_t k = 0; k < count; k++) {
+            if (as_float) {
+                float value = float(parameters(k));
+                std::memcpy(data + k * 4, &value, 4);
+            } else {
+                double value = parameters(k);
+                std::memcpy(data + k * 8, &value, 8);
+            }
+        }
+        std::memcpy(body.data() + inference_offset - sizeof(ModelFileHeader), inference.layout(), layout_size * 4);
+        header.checksum = modelChecksum(body.data(), body.size());
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            out.write(reinterpret_cast<char const*>(body.data()), body.size());
+            if (!out) {
+                throw std::runtime_error("cannot write model file " + temporary);
+            }
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("cannot write model file " + path);
+        }
+    }
+
+    // Maps a model file read-only and checks its header and checksum. The parameters are copied out,
+    // see copyParameters; the inference weights are read in place and keep the mapping alive after
+    // the reader is gone, see inferenceWeights.
+    class ModelFileReader {
+        std::shared_ptr<uint8_t const> m_mapping;
+        uint8_t const* m_data = nullptr;
+        std::size_t m_size = 0;
+
+        ModelFileHeader const& m_header() const { return *reinterpret_cast<ModelFileHeader const*>(m_data); }
+
+    public:
+        explicit ModelFileReader(std::string const& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("cannot open model file " + path);
+            }
+            struct stat st;
+            fstat(fd, &st);
+            m_size = st.st_size;
+            if (m_size < sizeof(ModelFileHeader)) {
+                close(fd);
+                throw std::runtime_error("not a model file: " + path);
+            }
+            // the mapping stays valid after the file is closed
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED) {
+                throw std::runtime_error("cannot map model file " + path);
+            }
+            std::size_t size = m_size;
+            m_mapping.reset(static_cast<uint8_t const*>(data),
+                            [size](uint8_t const* mapped) { munmap(const_cast<uint8_t*>(mapped), size); });
+            m_data = m_mapping.get();
+
+            ModelFileHeader const& header = m_header();
+            if (std::memcmp(header.magic, MODEL_FILE_MAGIC, 4) != 0
+                || (header.version != 1 && header.version != MODEL_FILE_VERSION)
+                || (header.scalarSize != 4 && header.scalarSize != 8)
+                || header.dataOffset % 64 != 0
+                || header.dataOffset < sizeof(ModelFileHeader) + uint64_t(header.numLayers) * sizeof(ModelFileLayer)
+                || header.dataOffset > m_size) {
+                throw std::runtime_error("not a model file: " + path);
+            }
+            uint64_t expected_size = header.dataOffset + header.numParameters * header.scalarSize;
+            if (header.version >= 2) {
+                expected_size = modelInferenceOffset(header) + MLPInference::layoutSize(shapes()) * 4;
+            }
+            if (expected_size != m_size) {
+                throw std::runtime_error("not a model file: " + path);
+            }
+            if (modelChecksum(m_data + sizeof(ModelFileHeader), m_size - sizeof(ModelFileHeader)) != header.checksum) {
+                throw std::runtime_error("wrong checksum of model file " + path);
+            }
+            std::size_t count = 0;
+            for (LayerShape const& shape : shapes()) {
+                count += std::size_t(shape.inputs) * shape.outputs + (shape.offset ? shape.outputs : 0);
+            }
+            if (count != header.numParameters) {
+                throw std::runtime_error("the parameters do not match the layers of model file " + path);
+            }
+        }
+
+        ModelFileReader(ModelFileReader const&) = delete;
+        ModelFileReader& operator=(ModelFileReader const&) = delete;
+
+        std::vector<LayerShape> shapes() const {
+            ModelFileLayer const* layers = reinterpret_cast<ModelFileLayer const*>(m_data + sizeof(ModelFileHeader));
+            std::vector<LayerShape> shapes;
+            for (uint32_t l = 0; l < m_header().numLayers; l++) {
+                shapes.push_back(LayerShape{layers[l].inputs, layers[l].outputs, Activation(layers[l].activation),
+                                            layers[l].offset != 0});
+            }
+            return shapes;
+        }
+
+        std::size_t numParameters() const { return m_header().numParameters; }
+        uint32_t version() const { return m_header().version; }
+        bool isFloat() const { return m_header().scalarSize == 4; }
+        uint64_t checksum() const { return m_header().checksum; }
+        std::size_t size() const { return m_size; }
+
+        // the float or double parameters, depending on isFloat()
+        void const* data() const { return m_data + m_header().dataOffset; }
+
+        // copies the parameters into a vector of numParameters() elements
+        template <class Parameters>
+        void copyParameters(Parameters& parameters) const {
+            std::size_t count = numParameters();
+            if (isFloat()) {
+                float const* values = static_cast<float const*>(data());
+                for (std::size_t k = 0; k < count; k++) { parameters(k) = values[k]; }
+            } else {
+                double const* values = static_cast<double const*>(data());
+                for (std::size_t k = 0; k < count; k++) { parameters(k) = values[k]; }
+            }
+        }
+
+        // The float32 weights in the layout of MLPInference::layout(), for MLPInference::mapWeights.
+        // They share the mapping, which is unmapped when the reader and the last of them are gone.
+        // Null for version 1 files.
+        std::shared_ptr<float const> inferenceWeights() const {
+            if (version() < 2) {
+                return nullptr;
+            }
+            return std::shared_ptr<float const>(m_mapping, reinterpret_cast<float const*>(m_data + modelInferenceOffset(m_header())));
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <boost/algorithm/string.hpp>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include "Hex.hpp"
+#include "hex_strategies.hpp"
+#include "hex_humanplay.hpp"
+#include "hex_embedded_model.hpp"
+
+using namespace Hex;
+
+// Plays against the model compiled in by the hex_play target (see CMakeLists.txt), with the protocol
+// of the play modes of hex, so playhex.py can start it in place of hex. The model plays blue: a TD
+// model takes the afterstate the opponent values lowest, a CSA-ES model samples its responses like
+// Game::takeStrategyTurn. With --book, the moves of an opening book written by hex abbook come first.
+static const unsigned N = EmbeddedModel::BOARD_SIZE;
+
+static_assert(EmbeddedModel::OUTPUTS == (EmbeddedModel::STRATEGY == 2 ? 1 : N*N),
+              "the embedded model is neither a TD nor a CSA-ES model of its board size");
+
+
+/***********\
+ *  Moves  *
+\***********/
+// the inputs of TDNetworkStrategy for the board seen by player
+void encodeTD(Board<N> const& board, unsigned player, float* input) {
+    BoardView<N> view(board, player == Red);
+    for (unsigned i = 0; i < N*N; i++) {
+        TileState state = view.at(i);
+        input[i] = (state == player ? 1.0f : (state != Empty ? -1.0f : 0.0f));
+    }
+}
+
+unsigned chooseTDMove(Game<N>& game) {
+    float input[N*N];
+    float value;
+    float best_value = std::numeric_limits<float>::max();
+    unsigned best = game.emptyCell(0);
+    for (unsigned k = 0; k < game.numEmptyCells(); k++) {
+        unsigned move = game.emptyCell(k);
+        game.makeMove(move);
+        encodeTD(game.getBoard(), game.ActivePlayer(), input);
+        game.unmakeMove();
+        EmbeddedModel::evaluate(input, &value);
+        if (value <= best_value) {
+            best_value = value;
+            best = move;
+        }
+    }
+    return best;
+}
+
+// the inputs of CSANetworkStrategy, which lists cell (i,j) of the view as input j*N+i
+unsigned chooseCSAMove(Game<N>& game) {
+    unsigned player = game.ActivePlayer();
+    BoardView<N> view(game.getBoard(), player == Red);
+    float input[N*N];
+    for (unsigned i = 0; i < N; i++) {
+        for (unsigned j = 0; j < N; j++) {
+            TileState state = view(i, j);
+            input[j*N + i] = (state == player ? 1.0f : (state != Empty ? -1.0f : 0.0f));
+        }
+    }
+    float output[N*N];
+    EmbeddedModel::evaluate(input, output);
+
+    uint8_t const* toView = (player == Red ? RotationTable<N>::get().toView : RotationTable<N>::get().identity);
+    double legal[N*N];
+    for (unsigned k = 0; k < game.numEmptyCells(); k++) {
+        legal[k] = output[toView[game.emptyCell(k)]];
+    }
+    return game.emptyCell(sampleSoftmax(legal, game.numEmptyCells(), currentRng()));
+}
+
+
+/**********\
+ *  Main  *
+\**********/
+int main(int argc, char* argv[]) {
+    // the arguments of hex: the size must be the one of the model, the model itself is compiled in
+    std::string what = "";
+    std::unique_ptr<OpeningBook<N>> book;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-s" || arg == "--size") {
+            if (i + 1 >= argc || unsigned(atoi(argv[i + 1])) != N) {
+                std::cerr << "hex_play was built for a " << N << "x" << N << " board" << std::endl;
+                return 1;
+            }
+            i++;
+        } else if (arg == "--book" && i + 1 < argc) {
+            book.reset(new OpeningBook<N>(argv[++i]));
+        } else if (what.length() == 0) {
+            what = arg;
+        } else if (arg.length() > 0) {
+            std::cerr << "hex_play plays its built in model, ignoring " << arg << std::endl;
+        }
+    }
+    bool for_python = boost::iends_with(what, "python");
+    setRngSeed(time(NULL));
+
+    playAgainstHuman<N>(for_python, [&](Game<N>& game) {
+        std::pair<double, int> book_move;
+        if (book && book->find(game.getBoard(), Blue, book_move)) {
+            return unsigned(book_move.second);
+        }
+        return EmbeddedModel::STRATEGY == 2 ? chooseTDMove(game) : chooseCSAMove(game);
+    });
+    return 0;
+}
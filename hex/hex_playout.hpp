@@ -0,0 +1,62 @@
+#ifndef HEX_PLAYOUT_HPP
+#define HEX_PLAYOUT_HPP
+
+#include "Hex.hpp"
+
+using namespace shark;
+
+namespace Hex {
+
+    /********************\
+     *  Random playout  *
+    \********************/
+    // Hex has no draws, and the stones played after a win do not change the winner. So a game
+    // between two uniformly random players has the same winner as filling every empty cell at once:
+    // the player to move gets a random half of the empty cells (the extra one if the number is odd)
+    // and the opponent gets the rest. One flood fill on the full board then decides the game,
+    // instead of a union-find update per move.
+    template <unsigned N>
+    class RandomPlayout {
+        static const unsigned CELLS = N * N;
+        static const unsigned WORDS = (CELLS + 63) / 64;
+
+    public:
+        // winner of a random continuation of the position with the given player to move
+        static unsigned winner(Board<N> const& board, unsigned toMove) {
+            uint8_t empty[CELLS];
+            unsigned numEmpty = 0;
+            for (unsigned i = 0; i < CELLS; i++) {
+                if (board.empty(i)) {
+                    empty[numEmpty++] = i;
+                }
+            }
+
+            // a partial Fisher-Yates shuffle picks the cells of the player to move
+            uint64_t blue[WORDS];
+            for (unsigned w = 0; w < WORDS; w++) {
+                blue[w] = board.stones(Blue)[w];
+            }
+            unsigned numBlue = (toMove == Blue ? (numEmpty + 1) / 2 : numEmpty / 2);
+            for (unsigned k = 0; k < numBlue; k++) {
+                std::size_t pick = random::discrete(currentRng(), std::size_t(k), std::size_t(numEmpty - 1));
+                std::swap(empty[k], empty[pick]);
+                blue[empty[k] / 64] |= uint64_t(1) << (empty[k] % 64);
+            }
+
+            // on a full board exactly one color is connected
+            return FloodFill<N>::connected(blue, Blue) ? Blue : Red;
+        }
+
+        static unsigned winner(Game<N> const& game) {
+            return winner(game.getBoard(), game.ActivePlayer());
+        }
+
+        // winner of a random game from the empty board, with a random starting player like Game::reset
+        static unsigned winner() {
+            static const Board<N> empty;
+            return winner(empty, random::coinToss(currentRng()) ? Blue : Red);
+        }
+    };
+}
+
+#endif
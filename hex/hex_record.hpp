@@ -0,0 +1,159 @@
+#ifndef HEX_RECORD_HPP
+#define HEX_RECORD_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Hex {
+
+    /******************\
+     *  Game records  *
+    \******************/
+    // Binary game records. A file starts with a GameRecordFileHeader and holds finished games back to
+    // back. Each game is a GameRecordHeader followed by one byte per move (the cell index row*N+col,
+    // in the order played, starting with firstPlayer). All fields are little endian and fixed size,
+    // so a mapped file can be read in place.
+    struct GameRecordFileHeader {
+        char magic[4];          // "HXGR"
+        uint32_t version;
+    };
+
+    struct GameRecordHeader {
+        uint8_t boardSize;
+        uint8_t firstPlayer;
+        uint8_t winner;
+        uint8_t numMoves;
+        int8_t strategies[2];   // Strategy::type() of the blue and the red player, 0 if not known
+        uint16_t reserved;
+        uint64_t seed;          // seed of the run that played the game
+    };
+
+    static_assert(sizeof(GameRecordFileHeader) == 8, "record file header must be packed");
+    static_assert(sizeof(GameRecordHeader) == 16, "record header must be packed");
+
+    static const char GAME_RECORD_MAGIC[4] = {'H', 'X', 'G', 'R'};
+    static const uint32_t GAME_RECORD_VERSION = 1;
+
+    // Appends finished games to a record file, creating it if needed. Safe to share between threads.
+    class GameRecordWriter {
+        std::ofstream m_out;
+        std::mutex m_mutex;
+        uint64_t m_seed;
+        uint64_t m_games = 0;
+
+    public:
+        GameRecordWriter(std::string const& path, uint64_t seed) : m_seed(seed) {
+            m_out.open(path, std::ios::binary | std::ios::app);
+            if (!m_out) {
+                throw std::runtime_error("cannot open game record file " + path);
+            }
+            if (m_out.tellp() == 0) {
+                GameRecordFileHeader header;
+                std::memcpy(header.magic, GAME_RECORD_MAGIC, 4);
+                header.version = GAME_RECORD_VERSION;
+                m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            }
+        }
+
+        void write(GameRecordHeader header, uint8_t const* moves) {
+            header.reserved = 0;
+            header.seed = m_seed;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            m_out.write(reinterpret_cast<char const*>(moves), header.numMoves);
+            m_games++;
+        }
+
+        uint64_t gamesWritten() const { return m_games; }
+    };
+
+    // One game of a mapped record file, pointing into the mapping
+    struct GameRecord {
+        GameRecordHeader const* header;
+        uint8_t const* moves;
+    };
+
+    // Maps a record file read-only and walks its games without copying or parsing them
+    class GameRecordReader {
+        int m_fd = -1;
+        uint8_t const* m_data = nullptr;
+        std::size_t m_size = 0;
+
+    public:
+        class iterator {
+            uint8_t const* m_pos;
+            uint8_t const* m_end;
+
+            // past the last complete game, a game cut short by a crash of the writer is not visited
+            bool m_at_end() const {
+                std::size_t left = m_end - m_pos;
+                return left < sizeof(GameRecordHeader)
+                    || left < sizeof(GameRecordHeader) + reinterpret_cast<GameRecordHeader const*>(m_pos)->numMoves;
+            }
+        public:
+            iterator(uint8_t const* pos, uint8_t const* end) : m_pos(pos), m_end(end) {}
+            GameRecord operator*() const {
+                GameRecordHeader const* header = reinterpret_cast<GameRecordHeader const*>(m_pos);
+                return GameRecord{header, m_pos + sizeof(GameRecordHeader)};
+            }
+            iterator& operator++() {
+                m_pos += sizeof(GameRecordHeader) + reinterpret_cast<GameRecordHeader const*>(m_pos)->numMoves;
+                return *this;
+            }
+            bool operator!=(iterator const& other) const {
+                if (m_at_end() || other.m_at_end()) { return m_at_end() != other.m_at_end(); }
+                return m_pos != other.m_pos;
+            }
+        };
+
+        explicit GameRecordReader(std::string const& path) {
+            m_fd = open(path.c_str(), O_RDONLY);
+            if (m_fd < 0) {
+                throw std::runtime_error("cannot open game record file " + path);
+            }
+            struct stat st;
+            fstat(m_fd, &st);
+            m_size = st.st_size;
+            if (m_size < sizeof(GameRecordFileHeader)) {
+                close(m_fd);
+                throw std::runtime_error("not a game record file: " + path);
+            }
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+            if (data == MAP_FAILED) {
+                close(m_fd);
+                throw std::runtime_error("cannot map game record file " + path);
+            }
+            m_data = static_cast<uint8_t const*>(data);
+            madvise(data, m_size, MADV_SEQUENTIAL);
+
+            GameRecordFileHeader const* header = reinterpret_cast<GameRecordFileHeader const*>(m_data);
+            if (std::memcmp(header->magic, GAME_RECORD_MAGIC, 4) != 0 || header->version != GAME_RECORD_VERSION) {
+                munmap(data, m_size);
+                close(m_fd);
+                throw std::runtime_error("not a game record file: " + path);
+            }
+        }
+
+        ~GameRecordReader() {
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+            close(m_fd);
+        }
+
+        GameRecordReader(GameRecordReader const&) = delete;
+        GameRecordReader& operator=(GameRecordReader const&) = delete;
+
+        iterator begin() const { return iterator(m_data + sizeof(GameRecordFileHeader), m_data + m_size); }
+        iterator end() const { return iterator(m_data + m_size, m_data + m_size); }
+    };
+}
+
+#endif
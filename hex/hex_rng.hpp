@@ -0,0 +1,132 @@
+#ifndef HEX_RNG_HPP
+#define HEX_RNG_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+namespace Hex {
+
+    /************\
+     *  Philox  *
+    \************/
+    // Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as
+    // 1, 2, 3"). Each output block is a keyed bijection of a 128 bit counter, so a stream is just a
+    // (key, counter prefix) pair: streams need no shared state, cost nothing to create and never
+    // overlap. Models a uniform random bit generator, so it works with the shark::random functions.
+    class Philox {
+        uint32_t m_key[2];
+        uint32_t m_counter[4];      // [0], [1]: position in the stream, [2], [3]: stream id
+        uint32_t m_block[4];
+        unsigned m_used = 4;
+
+        static void m_mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+            uint64_t product = uint64_t(a) * b;
+            hi = uint32_t(product >> 32);
+            lo = uint32_t(product);
+        }
+
+    public:
+        typedef uint32_t result_type;
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<uint32_t>::max(); }
+
+        Philox(uint64_t key, uint64_t stream) {
+            m_key[0] = uint32_t(key);
+            m_key[1] = uint32_t(key >> 32);
+            m_counter[0] = m_counter[1] = 0;
+            m_counter[2] = uint32_t(stream);
+            m_counter[3] = uint32_t(stream >> 32);
+        }
+
+        // the block of the current counter, without advancing
+        static void block(uint32_t const* counter, uint32_t const* key, uint32_t* out) {
+            uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+            uint32_t k[2] = {key[0], key[1]};
+            for (unsigned round = 0; round < 10; round++) {
+                uint32_t hi0, lo0, hi1, lo1;
+                m_mulhilo(0xD2511F53, c[0], hi0, lo0);
+                m_mulhilo(0xCD9E8D57, c[2], hi1, lo1);
+                c[0] = hi1 ^ c[1] ^ k[0];
+                c[1] = lo1;
+                c[2] = hi0 ^ c[3] ^ k[1];
+                c[3] = lo0;
+                k[0] += 0x9E3779B9;
+                k[1] += 0xBB67AE85;
+            }
+            out[0] = c[0]; out[1] = c[1]; out[2] = c[2]; out[3] = c[3];
+        }
+
+        result_type operator()() {
+            if (m_used == 4) {
+                block(m_counter, m_key, m_block);
+                if (++m_counter[0] == 0) { ++m_counter[1]; }
+                m_used = 0;
+            }
+            return m_block[m_used++];
+        }
+    };
+
+    /*****************\
+     *  RNG streams  *
+    \*****************/
+    // Every random decision draws from currentRng(), the stream of the calling thread. Work that has
+    // to be reproducible installs a stream keyed by what it is, with an RngScope, e.g. the games of
+    // one ES offspring in one generation. Its results then do not depend on which thread runs it or
+    // on how many threads there are. Everything else draws from a stream of its own per thread.
+
+    namespace detail {
+        inline uint64_t mix(uint64_t x) {
+            x += 0x9E3779B97F4A7C15ULL;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            return x ^ (x >> 31);
+        }
+
+        inline uint64_t& rngSeed() {
+            static uint64_t seed = 0;
+            return seed;
+        }
+
+        inline Philox*& installedRng() {
+            static thread_local Philox* rng = nullptr;
+            return rng;
+        }
+    }
+
+    // seed of all streams, set once at startup
+    inline void setRngSeed(uint64_t seed) { detail::rngSeed() = seed; }
+    inline uint64_t rngSeed() { return detail::rngSeed(); }
+
+    // the stream with the given key under the current seed
+    inline Philox rngStream(uint64_t generation, uint64_t offspring, uint64_t game, uint64_t thread) {
+        uint64_t stream = detail::mix(detail::mix(detail::mix(detail::mix(generation) ^ offspring) ^ game) ^ thread);
+        return Philox(rngSeed(), stream);
+    }
+
+    // installs a stream for the calling thread until the scope ends
+    class RngScope {
+        Philox m_rng;
+        Philox* m_previous;
+    public:
+        explicit RngScope(Philox const& rng) : m_rng(rng), m_previous(detail::installedRng()) {
+            detail::installedRng() = &m_rng;
+        }
+        ~RngScope() { detail::installedRng() = m_previous; }
+        RngScope(RngScope const&) = delete;
+        RngScope& operator=(RngScope const&) = delete;
+    };
+
+    inline Philox& currentRng() {
+        Philox* installed = detail::installedRng();
+        if (installed) {
+            return *installed;
+        }
+        // threads are numbered in the order they first draw, the main thread usually gets 0
+        static std::atomic<uint64_t> threads(0);
+        static thread_local Philox own = rngStream(~uint64_t(0), ~uint64_t(0), ~uint64_t(0), threads++);
+        return own;
+    }
+}
+
+#endif
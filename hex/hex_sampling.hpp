@@ -0,0 +1,94 @@
+#ifndef HEX_SAMPLING_HPP
+#define HEX_SAMPLING_HPP
+
+#include <shark/Core/Random.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace Hex {
+
+    /*****************\
+     *  Sampling     *
+    \*****************/
+    // Softmax sampling over the legal moves only. Callers gather the preferences of the legal moves
+    // into a small array on the stack, so nothing is allocated and infeasible cells are never touched.
+
+    namespace detail {
+#ifdef __AVX2__
+        // exp of four doubles in [-708, 0]: x = k*ln2 + r with |r| <= ln2/2, exp(r) by a degree 12
+        // Taylor polynomial (relative error below 1e-13) and 2^k built directly in the exponent bits
+        inline __m256d exp4(__m256d x) {
+            const __m256d magic = _mm256_set1_pd(6755399441055744.0);      // 2^52 + 2^51, rounds to integers
+            x = _mm256_max_pd(x, _mm256_set1_pd(-708.0));
+            __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634)),
+                                        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(k, _mm256_set1_pd(6.93147180369123816490e-01)));
+            r = _mm256_sub_pd(r, _mm256_mul_pd(k, _mm256_set1_pd(1.90821492927058770002e-10)));
+
+            const double coefficients[11] = {
+                1.0 / 39916800, 1.0 / 3628800, 1.0 / 362880, 1.0 / 40320, 1.0 / 5040, 1.0 / 720,
+                1.0 / 120, 1.0 / 24, 1.0 / 6, 1.0 / 2, 1.0
+            };
+            __m256d p = _mm256_set1_pd(1.0 / 479001600);
+            for (unsigned i = 0; i < 11; i++) {
+                p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(coefficients[i]));
+            }
+            p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0));
+
+            __m256i bits = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(k, magic)), _mm256_castpd_si256(magic));
+            __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(1023)), 52));
+            return _mm256_mul_pd(p, scale);
+        }
+#endif
+    }
+
+    // Replaces preferences[0..n) by their softmax weights exp(preference - max) and returns the sum
+    inline double softmaxWeights(double* preferences, unsigned n) {
+        double max_pref = preferences[0];
+        for (unsigned k = 1; k < n; k++) {
+            max_pref = std::max(max_pref, preferences[k]);
+        }
+        double total = 0.0;
+        unsigned k = 0;
+#ifdef __AVX2__
+        __m256d max4 = _mm256_set1_pd(max_pref);
+        __m256d total4 = _mm256_setzero_pd();
+        for (; k + 4 <= n; k += 4) {
+            __m256d w = detail::exp4(_mm256_sub_pd(_mm256_loadu_pd(preferences + k), max4));
+            _mm256_storeu_pd(preferences + k, w);
+            total4 = _mm256_add_pd(total4, w);
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, total4);
+        total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        for (; k < n; k++) {
+            preferences[k] = std::exp(preferences[k] - max_pref);
+            total += preferences[k];
+        }
+        return total;
+    }
+
+    // Samples k in [0, n) with probability softmax(preferences)[k], overwriting the preferences
+    template <class Rng>
+    unsigned sampleSoftmax(double* preferences, unsigned n, Rng& rng) {
+        double total = softmaxWeights(preferences, n);
+        double u = shark::random::uni(rng, 0.0, total);
+        double cumulant = 0.0;
+        for (unsigned k = 0; k < n; k++) {
+            cumulant += preferences[k];
+            if (cumulant > u) {
+                return k;
+            }
+        }
+        return n - 1;
+    }
+}
+
+#endif
@@ -2,6 +2,11 @@
 #define STRATEGIES_H
 
 #include "Hex.hpp"
+#include "hex_batch.hpp"
+#include "hex_cache.hpp"
+#include "hex_mlp.hpp"
+#include "hex_accumulator.hpp"
+#include "hex_conv.hpp"
 
 #include <shark/Models/LinearModel.h>//single dense layer
 #include <shark/Models/ConvolutionalModel.h>//single convolutional layer
@@ -13,10 +18,27 @@ namespace Hex {
 
 /* Neural network strategies */
 
+// The move of the afterstate values with the lowest value (the opponent's chance to win), paired
+// with the value of the move for the player to move
+inline std::pair<double, int> chooseLowestValue(std::vector<std::pair<double, int>> const& move_values) {
+    std::pair<double, int> chosen_move( std::numeric_limits<double>::max(), -1 );
+    for (std::size_t i=0; i < move_values.size(); i++) {
+        if (move_values[i].first <= chosen_move.first) {
+            chosen_move = move_values[i];
+        }
+    }
+    if (chosen_move.second == -1) {
+        throw std::runtime_error("Chosen move is -1");
+    }
+    chosen_move.first = 1 - chosen_move.first;
+    return chosen_move;
+}
+
 /***********************\
  * TD Network Strategy *
 \***********************/
-class TDNetworkStrategy : public Strategy {
+template <unsigned N>
+class TDNetworkStrategy : public Strategy<N> {
 private:
     LinearModel<RealVector, RectifierNeuron> m_inLayer;
     LinearModel<RealVector, RectifierNeuron> m_hiddenLayer;
@@ -24,7 +46,7 @@ private:
     ConcatenatedModel<RealVector> m_moveNet;
 
     // define input and output dimensions of network
-    int inputDim = Hex::BOARD_SIZE * Hex::BOARD_SIZE;
+    int inputDim = N * N;
     int outputDim = 1;
     // Define shape of hidden layer
     int hiddenIn = 80;
@@ -33,126 +55,186 @@ private:
     unsigned m_color;
     double m_epsilon = 0.1;
 
+    // values of positions already evaluated, shared with copies of the strategy like the layers are
+    std::shared_ptr<EvalCache> m_cache;
+
+    // float32 m_moveNet for playing, see setParameters; modelLoaded maps it from binary models
+    MLPInference m_inference;
+    // its first layer for the last board a move was chosen on, so afterstates cost one weight row
+    BoardAccumulator<N> m_accumulator;
+    Precision m_precision = Precision::Float32;
+
+    // buffers kept across calls, so choosing moves and setting parameters do not allocate
+    std::vector<std::pair<double, int>> m_move_values;
+    RealVector m_parameters;
+
+    // encode board so active player's tiles are 1.0, opponent players tiles are -1.0 and empty tiles are 0.0.
+    // The red player sees the board rotated counterclockwise, like in Game::takeStrategyTurn.
+    template <class Set>
+    static void m_encode(Board<N> const& board, unsigned int activePlayer, Set&& set) {
+        BoardView<N> view(board, activePlayer == Red);
+        for (unsigned i=0; i < N*N; i++) {
+            TileState state = view.at(i);
+            if (state == activePlayer) {        // Channel where players own tiles are
+                set(i, 1.0);
+            } else if (state != Hex::Empty) {   // Channel where other players tiles are
+                set(i, -1.0);
+            } else {
+                set(i, 0.0);
+            }
+        }
+    }
+
 public:
 	TDNetworkStrategy(){
         m_inLayer.setStructure(inputDim, hiddenIn);
         m_hiddenLayer.setStructure(hiddenIn, hiddenOut );
         m_outLayer.setStructure(hiddenOut , 1);
         m_moveNet = m_inLayer >> m_hiddenLayer >> m_outLayer;
+
+        m_inference.addLayer(inputDim, hiddenIn, Activation::Rectifier);
+        m_inference.addLayer(hiddenIn, hiddenOut, Activation::Rectifier);
+        m_inference.addLayer(hiddenOut, 1, Activation::Logistic);
+        m_inference.setParameters(m_moveNet.parameterVector());
     }
 
-    void createInput( shark::blas::matrix<Tile>const& field, unsigned int activePlayer, RealVector& inputs) {
-        inputs.clear();
-        // encode board so active player's tiles are 1.0, opponent players tiles are -1.0 and empty tiles are 0.0
-        for (int i=0; i < BOARD_SIZE; i++) {
-            for (int j=0; j< BOARD_SIZE; j++) {
-                if(field(i,j).tileState == activePlayer){       // Channel where players own tiles are
-                    //inputs(3*(i*Hex::BOARD_SIZE+j)) = 1.0;
-                    inputs(i*Hex::BOARD_SIZE+j) = 1.0;
-                }
-                else if(field(i,j).tileState != Hex::Empty ) {  // Channel where other players tiles are
-                    //inputs(3*(i*Hex::BOARD_SIZE+j)+1) = 1.0;
-                    inputs(i*Hex::BOARD_SIZE+j) = -1.0;
-                }
-            }
-        }
+    // inputs is a RealVector or a row of an input batch
+    template <class Input>
+    void createInput(Board<N> const& board, unsigned int activePlayer, Input&& inputs) {
+        m_encode(board, activePlayer, [&](unsigned i, double value) { inputs(i) = value; });
     }
 
     // takes encoded inputs and evaluates model
-    double evaluateNetwork(RealVector inputs) {
+    double evaluateNetwork(RealVector const& inputs) {
         RealVector outputs;
         m_moveNet.eval(inputs, outputs);
         return outputs[0];
     }
 
-    // choose a move given possible move_values
-    std::pair<double, int> chooseMove(std::vector<std::pair<double, int>> move_values, unsigned activeplayer, RealVector feasible_moves, bool epsilon_greedy) {
-        std::pair<double, int> chosen_move( std::numeric_limits<double>::max() * (activeplayer==Blue ? -1 : -1) , -1 );
-        double u = shark::random::uni(shark::random::globalRng(), 0.0, 1.0);
-        if (epsilon_greedy && u < m_epsilon) {
-            // if epsilon greedy we pick a random empty tile
-            int ri = shark::random::uni(shark::random::globalRng(), 0, sum(feasible_moves)-1);
-            int move_val_idx = 0;
-            for (int i=0; i < feasible_moves.size(); i++) {
-                if (feasible_moves(i) == 1) {
-                    if (ri == 0) {
-                        chosen_move = move_values[move_val_idx];
-                        break;
-                    }
-                    ri--;
-                    move_val_idx++;
-                }
+    MLPInference const& inference() const {
+        return m_inference;
+    }
+
+    // arithmetic of the move values, Double evaluates m_moveNet itself
+    void setPrecision(Precision precision) {
+        m_precision = precision;
+        m_inference.setPrecision(precision);
+        if (m_cache) { m_cache->clear(); }
+    }
+
+    Precision precision() const {
+        return m_precision;
+    }
+
+    // value of a move: the afterstate is valued from the point of view of the opponent, from the
+    // accumulator of the board with the stone of the move added. The move is only played and taken
+    // back on the game to look up the cache.
+    double getMoveValue(Game<N>& game, unsigned move) {
+        unsigned player = game.ActivePlayer();
+        game.makeMove(move);
+        uint64_t hash = game.hash();
+        game.unmakeMove();
+        double value;
+        if (!m_cache || !m_cache->lookup(hash, value)) {
+            if (m_precision == Precision::Double) {
+                RealVector input(N*N);
+                game.makeMove(move);
+                createInput(game.getBoard(), game.ActivePlayer(), input);
+                game.unmakeMove();
+                value = evaluateNetwork(input);
+            } else {
+                m_accumulator.update(m_inference, game.getBoard());
+                value = m_accumulator.evalAfterstate(m_inference, 1 - player, player, move)[0];
             }
-        } else {
-            // if not epsilon greedy, we pick the move with the lowest associated value
-            for(int i=0; i < move_values.size(); i++) {
-                if (move_values[i].first >= chosen_move.first ) {
-                    chosen_move = move_values[i];
+            if (m_cache) { m_cache->store(hash, value); }
+        }
+        return value;
+    }
+
+    // calculate all move values (a value for each empty cell). The afterstates missing from the cache
+    // are valued from the accumulator of the current board, with the stone of the move added to it.
+    // The values stay valid until the next call.
+    std::vector<std::pair<double, int>> const& getMoveValues(Game<N>& game) {
+        unsigned num_empty = game.numEmptyCells();
+        unsigned player = game.ActivePlayer();
+        std::vector<std::pair<double, int>>& move_values = m_move_values;
+        move_values.resize(num_empty);
+        // distinct afterstate of every move whose value is not cached. Symmetric afterstates are
+        // valued once, like they would share the cache entry of the first one evaluated.
+        int rows[N*N];
+        unsigned moves[N*N];
+        uint64_t hashes[N*N];
+        unsigned num_rows = 0;
+
+        for (unsigned k=0; k < num_empty; k++) {
+            unsigned move = game.emptyCell(k);
+            move_values[k].second = move;
+            rows[k] = -1;
+            game.makeMove(move);
+            uint64_t hash = game.hash();
+            if (!m_cache || !m_cache->lookup(hash, move_values[k].first)) {
+                rows[k] = num_rows;
+                for (unsigned r=0; m_cache && r < num_rows; r++) {
+                    if (hashes[r] == hash) { rows[k] = r; break; }
+                }
+                if (rows[k] == int(num_rows)) {
+                    moves[num_rows] = move;
+                    hashes[num_rows++] = hash;
                 }
             }
+            game.unmakeMove();
         }
-        if (chosen_move.second == -1) {
-            throw std::runtime_error("Chosen move is -1");
+        if (num_rows == 0) {
+            return move_values;
         }
-        chosen_move.first = 1 - chosen_move.first;
-        return chosen_move;
-    }
 
-    // returns a copy of game field
-    shark::blas::matrix<Tile> getFieldCopy(shark::blas::matrix<Tile> field) {
-        shark::blas::matrix<Tile> fieldCopy(BOARD_SIZE, BOARD_SIZE);
-        for (int i=0; i < BOARD_SIZE; i++) {
-            for (int j=0; j < BOARD_SIZE; j++) {
-                fieldCopy(i,j) = Tile();
-                fieldCopy(i,j).tileState = field(i,j).tileState;
+        double values[N*N];
+        if (m_precision == Precision::Double) {
+            // the afterstates as the rows of one batch of the Shark network
+            RealMatrix inputs(num_rows, N*N);
+            for (unsigned r=0; r < num_rows; r++) {
+                game.makeMove(moves[r]);
+                createInput(game.getBoard(), game.ActivePlayer(), row(inputs, r));
+                game.unmakeMove();
+            }
+            RealMatrix outputs;
+            m_moveNet.eval(inputs, outputs);
+            for (unsigned r=0; r < num_rows; r++) {
+                values[r] = outputs(r, 0);
+            }
+        } else {
+            // the afterstates are valued by the opponent, who sees the new stone as the other player's
+            m_accumulator.update(m_inference, game.getBoard());
+            for (unsigned r=0; r < num_rows; r++) {
+                values[r] = m_accumulator.evalAfterstate(m_inference, 1 - player, player, moves[r])[0];
             }
         }
-        return fieldCopy;
-    }
-
-    // calculate all move values (a value for each feasible move)
-    std::vector<std::pair<double, int>> getMoveValues(shark::blas::matrix<Tile>& fieldCopy, unsigned activePlayer, RealVector feasible_moves) {
-        std::vector<std::pair<double, int>> move_values;
-        int inputIdx=0;
-        RealVector input((BOARD_SIZE*BOARD_SIZE), 0.0);
-
-        double max;
-        for (int i=0; i<feasible_moves.size(); i++) {
-            if (feasible_moves(i) == 1) {
-                int x = i % BOARD_SIZE;
-                int y = i / BOARD_SIZE;
-                fieldCopy(x,y).tileState = (TileState)activePlayer;
-                fieldCopy = rotateField(fieldCopy, activePlayer == Red);
-                createInput(fieldCopy, activePlayer == Blue ? Red : Blue, input);
-                double value = this->evaluateNetwork(input);
-                std::pair<double, int> valPair = std::pair<double, int>(value, i);
-                move_values.push_back(valPair);
-                fieldCopy(x,y).tileState = Empty;
+        for (unsigned k=0; k < num_empty; k++) {
+            if (rows[k] >= 0) { move_values[k].first = values[rows[k]]; }
+        }
+        if (m_cache) {
+            for (unsigned r=0; r < num_rows; r++) {
+                m_cache->store(hashes[r], values[r]);
             }
         }
         return move_values;
     }
 
-    // choose an action given a board and feasible moves
-    std::pair<double, int> getChosenMove(Game game, bool epsilon_greedy) {
-        shark::blas::matrix<Tile> fieldCopy;
-        unsigned activePlayer = game.ActivePlayer();
-        if (activePlayer == Hex::Red) {
-            fieldCopy = rotateField(game.getGameBoard(), false); // if player 2, rotate view counter-clockwise
-        } else {
-            fieldCopy = getFieldCopy(game.getGameBoard());
+    // choose an action for the active player of the game. The game is left as it was.
+    std::pair<double, int> getChosenMove(Game<N>& game, bool epsilon_greedy) {
+        std::pair<double, int> book_move;
+        if (this->bookMove(game.getBoard(), game.ActivePlayer(), book_move)) {
+            return book_move;
         }
-        RealVector feasibleMoves = game.getFeasibleMoves(fieldCopy);
-        std::vector<std::pair<double, int>> move_values = getMoveValues(fieldCopy, activePlayer, feasibleMoves);
-        std::pair<double, int> chosen_move = chooseMove(move_values, activePlayer, feasibleMoves, epsilon_greedy);
-
-        if (activePlayer == Hex::Red) {
-            chosen_move.second = flipToOriginalRotatedIndex(chosen_move.second);
+        if (epsilon_greedy && shark::random::uni(currentRng(), 0.0, 1.0) < m_epsilon) {
+            // if epsilon greedy we pick a random empty tile
+            unsigned move = game.randomEmptyCell();
+            return std::pair<double, int>(1 - getMoveValue(game, move), move);
         }
-        return chosen_move;
+        return chooseLowestValue(getMoveValues(game));
     }
 
-    ConcatenatedModel<RealVector> GetMoveModel() override {
+    ConcatenatedModel<RealVector>& GetMoveModel() override {
         return m_moveNet;
     };
 
@@ -160,15 +242,41 @@ public:
         m_color = color;
     }
 
+    // Caches move values by Game::hash(), so positions seen before skip the network. Positions that
+    // are symmetric to each other share the value of the first one evaluated. The cache is cleared
+    // by setParameters; enable it after loading a model.
+    void enableCache(unsigned log2_slots = 18) {
+        m_cache = std::make_shared<EvalCache>(log2_slots);
+    }
+
+    EvalCache const* cache() const {
+        return m_cache.get();
+    }
+
 	std::size_t numParameters() const{
 		return m_moveNet.numberOfParameters();
 	}
 
-    void setParameters(shark::RealVector const& parameters){
-		auto p1 = subrange(parameters, 0, m_moveNet.numberOfParameters());
-		m_moveNet.setParameterVector(p1);
+    void setParameters(ParameterSpan parameters) override {
+		ParameterSpan p1 = parameters.subspan(0, m_moveNet.numberOfParameters());
+		m_parameters.resize(p1.size());
+		std::copy(p1.data(), p1.data() + p1.size(), &m_parameters(0));
+		m_moveNet.setParameterVector(m_parameters);
+		m_inference.setParameters(p1);
+		m_accumulator.reset(m_inference);
+		if (m_cache) { m_cache->clear(); }
 	}
 
+    void modelLoaded(std::shared_ptr<float const> const& inference_weights) override {
+        m_inference.setParameters(m_moveNet.parameterVector(), inference_weights);
+        m_accumulator.reset(m_inference);
+        if (m_cache) { m_cache->clear(); }
+    }
+
+    std::vector<LayerShape> layerShapes() const override {
+        return m_inference.shapes();
+    }
+
     void weightedParameterDerivative(RealMatrix input,
 									 RealMatrix output,
 									 RealMatrix weights,
@@ -192,7 +300,8 @@ public:
 /***************************\
  * CSA-ES Network Strategy *
 \***************************/
-class CSANetworkStrategy: public Hex::Strategy{
+template <unsigned N>
+class CSANetworkStrategy: public Hex::Strategy<N>{
 private:
 	LinearModel<RealVector, RectifierNeuron> m_inLayer;
 	LinearModel<RealVector, RectifierNeuron> m_hiddenLayer1;
@@ -201,14 +310,70 @@ private:
 	ConcatenatedModel<RealVector> m_moveNet;
 
     // define input and output dimensions of network
-    int inputDim = Hex::BOARD_SIZE * Hex::BOARD_SIZE;
-    int outputDim = Hex::BOARD_SIZE*Hex::BOARD_SIZE;
+    int inputDim = N * N;
+    int outputDim = N*N;
     // Define shape of hidden layer
     int hiddenIn = 80;
     int hiddenOut = 40;
 
     unsigned m_color;
 
+    // float32 m_moveNet for playing, see setParameters; modelLoaded maps it from binary models
+    MLPInference m_inference;
+    Precision m_precision = Precision::Float32;
+    RealVector m_parameters;
+
+    // find player position and prepare network position, field(i,j) is the state of cell (i,j). The inputs
+    // are 1 for own stones, -1 for the opponent's and 0 for empty cells, so only the indices of the
+    // stones are listed and the first layer gathers their weights.
+    struct Inputs {
+        unsigned own[N*N];
+        unsigned other[N*N];
+        unsigned num_own = 0;
+        unsigned num_other = 0;
+    };
+
+    template <class Field>
+    void m_encode(Field const& field, Inputs& inputs) const {
+		for(unsigned i = 0; i < N; i++){
+			for(unsigned j = 0; j < N; j++){
+				if(field(i,j) == m_color){ // Channel where players own tiles are 1
+                    inputs.own[inputs.num_own++] = j*N+i;
+                } else if (field(i,j) != Hex::Empty) {
+                    inputs.other[inputs.num_other++] = j*N+i;
+                }
+		    }
+        }
+    }
+
+    // writes the N*N responses to the field to response(i)
+    template <class Field, class Response>
+    void m_eval(Field const& field, Response&& response) const {
+        Inputs inputs;
+        m_encode(field, inputs);
+        if (m_precision == Precision::Double) {
+            RealVector dense(N*N, 0.0);
+            for (unsigned k = 0; k < inputs.num_own; k++) { dense(inputs.own[k]) = 1.0; }
+            for (unsigned k = 0; k < inputs.num_other; k++) { dense(inputs.other[k]) = -1.0; }
+            RealVector outputs = m_moveNet(dense);
+            for (unsigned i = 0; i < N*N; i++) {
+                response(i) = outputs(i);
+            }
+            return;
+        }
+        float const* outputs = m_inference.evalSparse(inputs.own, inputs.num_own, inputs.other, inputs.num_other);
+        for (unsigned i = 0; i < N*N; i++) {
+            response(i) = outputs[i];
+        }
+    }
+
+    template <class Field>
+    RealVector m_respond(Field const& field) const {
+        RealVector response(N*N);
+        m_eval(field, response);
+        return response;
+    }
+
 public:
 	CSANetworkStrategy(){
 		m_inLayer.setStructure(inputDim, hiddenIn );
@@ -216,6 +381,11 @@ public:
 		m_moveOut.setStructure(m_hiddenLayer1.outputShape(), outputDim);
 
         m_moveNet = m_inLayer >> m_hiddenLayer1 >> m_moveOut;
+
+        m_inference.addLayer(inputDim, hiddenIn, Activation::Rectifier);
+        m_inference.addLayer(hiddenIn, hiddenOut, Activation::Rectifier);
+        m_inference.addLayer(hiddenOut, outputDim, Activation::Rectifier);
+        m_inference.setParameters(m_moveNet.parameterVector());
 	}
 
     void save(OutArchive & archive) {
@@ -223,6 +393,7 @@ public:
     }
     void load(InArchive & archive) {
         m_moveNet.read(archive);
+        modelLoaded(nullptr);
     }
 
     void setColor(unsigned color) {
@@ -230,33 +401,77 @@ public:
     }
 
 	shark::RealVector getMoveAction(shark::blas::matrix<Hex::Tile>const& field) override{
-		//find player position and prepare network position
-		RealVector inputs((Hex::BOARD_SIZE*Hex::BOARD_SIZE),0.0);
-		for(int i = 0; i < Hex::BOARD_SIZE; i++){
-			for(int j = 0; j < Hex::BOARD_SIZE; j++){
-				if(field(i,j).tileState == m_color){ // Channel where players own tiles are 1
-                    inputs((j*Hex::BOARD_SIZE+i)) = 1.0;
-                } else if (field(i,j).tileState != Hex::Empty) {
-                    inputs((j*Hex::BOARD_SIZE+i)) = -1.0;
-                }
-		    }
+		return m_respond([&](unsigned i, unsigned j) { return field(i,j).tileState; });
+	}
+
+    // same as above, reading the board through the view without copying it
+    shark::RealVector getMoveAction(BoardView<N> const& view) override {
+        return m_respond(view);
+    }
+
+    // getMoveAction for the active players of several games of a batch, evaluated as one matrix.
+    // Row k holds the raw response for game slots[k], red players see the board rotated like in
+    // Game::takeStrategyTurn.
+    RealMatrix getMoveActions(GameBatch<N> const& batch, std::vector<std::size_t> const& slots) {
+        RealMatrix responses(slots.size(), N*N);
+        getMoveActions(batch, slots, responses);
+        return responses;
+    }
+
+    // same as above into the first rows of responses, which has at least slots.size() rows
+    void getMoveActions(GameBatch<N> const& batch, std::vector<std::size_t> const& slots, RealMatrix& responses) {
+        for (std::size_t k = 0; k < slots.size(); k++) {
+            RotationTable<N> const& rotation = RotationTable<N>::get();
+            uint8_t const* toBoard = (batch.activePlayer(slots[k]) == Red ? rotation.toBoard : rotation.identity);
+            m_eval([&](unsigned i, unsigned j) { return batch.at(slots[k], toBoard[i*N + j]); }, row(responses, k));
         }
+    }
 
-		//Get raw response for everything
-		RealVector response = m_moveNet(inputs);
-		return response;
-	}
+    MLPInference const& inference() const {
+        return m_inference;
+    }
+
+    // arithmetic of the responses, Double evaluates m_moveNet itself
+    void setPrecision(Precision precision) {
+        m_precision = precision;
+        m_inference.setPrecision(precision);
+    }
+
+    Precision precision() const {
+        return m_precision;
+    }
 
 	std::size_t numParameters() const override{
 		return m_moveNet.numberOfParameters();
 	}
 
-	void setParameters(shark::RealVector const& parameters) override{
-		auto p1 = subrange(parameters, 0, m_moveNet.numberOfParameters());
-		m_moveNet.setParameterVector(p1);
+	void setParameters(ParameterSpan parameters) override{
+		ParameterSpan p1 = parameters.subspan(0, m_moveNet.numberOfParameters());
+		m_parameters.resize(p1.size());
+		std::copy(p1.data(), p1.data() + p1.size(), &m_parameters(0));
+		m_moveNet.setParameterVector(m_parameters);
+		m_inference.setParameters(p1);
 	}
 
-    ConcatenatedModel<RealVector> GetMoveModel() override {
+    // Parameters to play with only, like those of an ES search point: read straight into the float
+    // network that plays, the Shark network keeps its weights unless Double precision plays from it.
+    void setPlayParameters(ParameterSpan parameters) {
+        if (m_precision == Precision::Double) {
+            setParameters(parameters);
+            return;
+        }
+        m_inference.setParameters(parameters.subspan(0, m_moveNet.numberOfParameters()));
+    }
+
+    void modelLoaded(std::shared_ptr<float const> const& inference_weights) override {
+        m_inference.setParameters(m_moveNet.parameterVector(), inference_weights);
+    }
+
+    std::vector<LayerShape> layerShapes() const override {
+        return m_inference.shapes();
+    }
+
+    ConcatenatedModel<RealVector>& GetMoveModel() override {
         return m_moveNet;
     };
 
@@ -265,20 +480,455 @@ public:
     }
 };
 
+/*************************************\
+ * Policy and Value Network Strategy *
+\*************************************/
+// One network for both choosing and valuing moves: a trunk like the one of TDNetworkStrategy with a
+// policy head of N*N move logits and a value head on top, so a move takes one forward pass over the
+// current board instead of one per afterstate. The heads are the outputs of the last layer: output v
+// is the logit of playing index v of the view of the player to move, output N*N the logit of that
+// player's chance to win. The inputs are those of TDNetworkStrategy.
+template <unsigned N>
+class DualHeadStrategy : public Strategy<N> {
+private:
+    LinearModel<RealVector, RectifierNeuron> m_inLayer;
+    LinearModel<RealVector, RectifierNeuron> m_hiddenLayer;
+    LinearModel<RealVector> m_heads;
+    ConcatenatedModel<RealVector> m_moveNet;
+
+    // define input and output dimensions of network
+    int inputDim = N * N;
+    int outputDim = N * N + 1;
+    // Define shape of hidden layer
+    int hiddenIn = 80;
+    int hiddenOut = 40;
+
+    unsigned m_color = Blue;
+
+    // float32 m_moveNet for playing, see setParameters; modelLoaded maps it from binary models
+    MLPInference m_inference;
+    Precision m_precision = Precision::Float32;
+    RealVector m_parameters;
+
+    // the indices of the view whose stones are the player's own and the opponent's, the network
+    // sees 1 and -1 there and 0 on the empty cells
+    struct Inputs {
+        unsigned own[N*N];
+        unsigned other[N*N];
+        unsigned num_own = 0;
+        unsigned num_other = 0;
+    };
+
+    // writes the N*N + 1 outputs for player to move to outputs, cell(v) is the state of index v of
+    // the player's view
+    template <class Cell>
+    void m_eval(Cell&& cell, unsigned player, double* outputs) const {
+        Inputs inputs;
+        for (unsigned v = 0; v < N*N; v++) {
+            TileState state = cell(v);
+            if (state == player) {
+                inputs.own[inputs.num_own++] = v;
+            } else if (state != Hex::Empty) {
+                inputs.other[inputs.num_other++] = v;
+            }
+        }
+        if (m_precision == Precision::Double) {
+            RealVector dense(N*N, 0.0);
+            for (unsigned k = 0; k < inputs.num_own; k++) { dense(inputs.own[k]) = 1.0; }
+            for (unsigned k = 0; k < inputs.num_other; k++) { dense(inputs.other[k]) = -1.0; }
+            RealVector response = m_moveNet(dense);
+            std::copy(response.begin(), response.end(), outputs);
+            return;
+        }
+        float const* response = m_inference.evalSparse(inputs.own, inputs.num_own, inputs.other, inputs.num_other);
+        std::copy(response, response + N*N + 1, outputs);
+    }
+
+    // the outputs for the active player of the game
+    void m_eval(Game<N> const& game, double* outputs) const {
+        BoardView<N> view(game.getBoard(), game.ActivePlayer() == Red);
+        m_eval([&](unsigned v) { return view.at(v); }, game.ActivePlayer(), outputs);
+    }
+
+    template <class Cell>
+    RealVector m_respond(Cell&& cell, unsigned player) const {
+        double outputs[N*N + 1];
+        m_eval(cell, player, outputs);
+        RealVector response(N*N);
+        std::copy(outputs, outputs + N*N, response.begin());
+        return response;
+    }
+
+public:
+    DualHeadStrategy() {
+        m_inLayer.setStructure(inputDim, hiddenIn);
+        m_hiddenLayer.setStructure(hiddenIn, hiddenOut);
+        m_heads.setStructure(hiddenOut, outputDim);
+        m_moveNet = m_inLayer >> m_hiddenLayer >> m_heads;
+
+        m_inference.addLayer(inputDim, hiddenIn, Activation::Rectifier);
+        m_inference.addLayer(hiddenIn, hiddenOut, Activation::Rectifier);
+        m_inference.addLayer(hiddenOut, outputDim, Activation::Linear);
+        m_inference.setParameters(m_moveNet.parameterVector());
+    }
+
+    // the chance to win of the player to move, from the output of the value head
+    static double value(double logit) {
+        return 1.0 / (1.0 + std::exp(-logit));
+    }
+
+    // inputs is a RealVector or a row of an input batch, encoded like for TDNetworkStrategy
+    template <class Input>
+    void createInput(Board<N> const& board, unsigned int activePlayer, Input&& inputs) {
+        BoardView<N> view(board, activePlayer == Red);
+        for (unsigned v = 0; v < N*N; v++) {
+            TileState state = view.at(v);
+            inputs(v) = (state == activePlayer ? 1.0 : (state != Hex::Empty ? -1.0 : 0.0));
+        }
+    }
+
+    // Chooses a move for the active player of the game from one evaluation: the empty cell with the
+    // highest logit, or one sampled from the softmax of the logits of the empty cells like
+    // Game::takeStrategyTurn does. Returns the chance to win of the player to move and the move.
+    // The game must not be finished.
+    std::pair<double, int> getChosenMove(Game<N> const& game, bool sample) {
+        if (game.finished()) {
+            throw std::invalid_argument("DualHeadStrategy: the game is finished, there is no move to choose");
+        }
+        std::pair<double, int> book_move;
+        if (this->bookMove(game.getBoard(), game.ActivePlayer(), book_move)) {
+            return book_move;
+        }
+        double outputs[N*N + 1];
+        m_eval(game, outputs);
+        uint8_t const* toView = (game.ActivePlayer() == Red ? RotationTable<N>::get().toView
+                                                            : RotationTable<N>::get().identity);
+        double legal[N*N];
+        unsigned chosen = 0;
+        for (unsigned k = 0; k < game.numEmptyCells(); k++) {
+            legal[k] = outputs[toView[game.emptyCell(k)]];
+            if (legal[k] > legal[chosen]) {
+                chosen = k;
+            }
+        }
+        if (sample) {
+            chosen = sampleSoftmax(legal, game.numEmptyCells(), currentRng());
+        }
+        return std::pair<double, int>(value(outputs[N*N]), game.emptyCell(chosen));
+    }
+
+    // the chance to win of the active player of the game
+    double getValue(Game<N> const& game) {
+        double outputs[N*N + 1];
+        m_eval(game, outputs);
+        return value(outputs[N*N]);
+    }
+
+    // the move logits, for the player set by setColor
+    RealVector getMoveAction(blas::matrix<Tile> const& field) override {
+        return m_respond([&](unsigned v) { return field(v / N, v % N).tileState; }, m_color);
+    }
+
+    // Game::takeStrategyTurn shows red the rotated board
+    RealVector getMoveAction(BoardView<N> const& view) override {
+        return m_respond([&](unsigned v) { return view.at(v); }, view.rotated() ? Red : Blue);
+    }
+
+    void setColor(unsigned color) {
+        m_color = color;
+    }
+
+    MLPInference const& inference() const {
+        return m_inference;
+    }
+
+    // arithmetic of the outputs, Double evaluates m_moveNet itself
+    void setPrecision(Precision precision) {
+        m_precision = precision;
+        m_inference.setPrecision(precision);
+    }
+
+    Precision precision() const {
+        return m_precision;
+    }
+
+    std::size_t numParameters() const override {
+        return m_moveNet.numberOfParameters();
+    }
+
+    void setParameters(ParameterSpan parameters) override {
+        ParameterSpan p1 = parameters.subspan(0, m_moveNet.numberOfParameters());
+        m_parameters.resize(p1.size());
+        std::copy(p1.data(), p1.data() + p1.size(), &m_parameters(0));
+        m_moveNet.setParameterVector(m_parameters);
+        m_inference.setParameters(p1);
+    }
+
+    void modelLoaded(std::shared_ptr<float const> const& inference_weights) override {
+        m_inference.setParameters(m_moveNet.parameterVector(), inference_weights);
+    }
+
+    std::vector<LayerShape> layerShapes() const override {
+        return m_inference.shapes();
+    }
+
+    ConcatenatedModel<RealVector>& GetMoveModel() override {
+        return m_moveNet;
+    };
+
+    boost::shared_ptr<State> createState() {
+        return m_moveNet.createState();
+    }
+
+    int type () override {
+        return 7;
+    }
+};
+
+/***********************************\
+ * Convolutional Network Strategy *
+\***********************************/
+// A value network like TDNetworkStrategy's, trained the same way, with hexagonal convolutions in
+// place of the dense layers: the weights are shared by all cells, so the number of parameters
+// barely grows with the board. See HexConvInference for the network and the input planes; the
+// Shark network is two Conv2DModel layers with 3 x 3 kernels whose corner taps are kept at zero
+// by setParameters, and a logistic unit.
+template <unsigned N>
+class ConvNetworkStrategy : public ReplayStrategy<N> {
+private:
+    typedef HexConvInference<N> Inference;
+    static const unsigned SIZE = Inference::SIZE;
+    static const unsigned CELLS = Inference::CELLS;
+    static const unsigned CHANNELS = Inference::CHANNELS;
+
+    Conv2DModel<RealVector, RectifierNeuron> m_conv1;
+    Conv2DModel<RealVector, RectifierNeuron> m_conv2;
+    LinearModel<RealVector, LogisticNeuron> m_outLayer;
+    ConcatenatedModel<RealVector> m_moveNet;
+
+    // filters of each convolution
+    unsigned filters = 16;
+
+    double m_epsilon = 0.1;
+
+    // values of positions already evaluated, like for TDNetworkStrategy
+    std::shared_ptr<EvalCache> m_cache;
+
+    // float32 copy of m_moveNet for playing, kept in sync by setParameters and modelLoaded
+    Inference m_inference;
+    Precision m_precision = Precision::Float32;
+
+    // buffers kept across calls, so choosing moves and setting parameters do not allocate
+    std::vector<std::pair<double, int>> m_move_values;
+    RealVector m_parameters;
+
+    // The planes of the image of the board for player: own stones and the two edges the player
+    // connects, the opponent's stones and edges, and empty cells. Red sees the board transposed,
+    // which keeps the six neighbours of every cell, where the rotation of the dense networks does
+    // not; either way the player connects the first and last column.
+    static void m_encode(Board<N> const& board, unsigned player, uint8_t* planes) {
+        for (unsigned row = 0; row < SIZE; row++) {
+            for (unsigned column = 0; column < SIZE; column++) {
+                bool border_row = (row == 0 || row == SIZE - 1);
+                bool border_column = (column == 0 || column == SIZE - 1);
+                uint8_t plane;
+                if (border_row && border_column) {
+                    plane = Inference::NO_PLANE;
+                } else if (border_column) {
+                    plane = 0;
+                } else if (border_row) {
+                    plane = 1;
+                } else {
+                    unsigned i = row - 1, j = column - 1;
+                    TileState state = board.at(player == Red ? j*N + i : i*N + j);
+                    plane = (state == player ? 0 : (state != Hex::Empty ? 1 : 2));
+                }
+                planes[row*SIZE + column] = plane;
+            }
+        }
+    }
+
+    // Zobrist hash of the board as m_encode shows it to the player, the cache key of its value.
+    // Game::hash() does not fit: it rotates red's view instead of transposing it and it identifies
+    // the two orientations of the board, which the convolutions do not.
+    uint64_t m_hash(Board<N> const& board, unsigned player) const {
+        ZobristKeys<N> const& zobrist = ZobristKeys<N>::get();
+        uint64_t hash = 0;
+        for (unsigned cell = 0; cell < N * N; cell++) {
+            TileState state = board.at(cell);
+            if (state != Hex::Empty) {
+                unsigned view = (player == Red ? cell % N * N + cell / N : cell);
+                hash ^= zobrist.keys[state == player ? 0 : 1][view];
+            }
+        }
+        return hash;
+    }
+
+    // zeroes the corner taps of the kernels of both convolutions
+    void m_mask(RealVector& parameters) const {
+        std::size_t p = 0;
+        for (unsigned inputs : {CHANNELS, filters}) {
+            for (unsigned f = 0; f < filters; f++) {
+                for (unsigned a = 0; a < 3; a++) {
+                    for (unsigned b = 0; b < 3; b++, p += inputs) {
+                        if (!Inference::isHexTap(a, b)) {
+                            std::fill(&parameters(p), &parameters(p) + inputs, 0.0);
+                        }
+                    }
+                }
+            }
+            p += filters;
+        }
+    }
+
+    // getMoveAction plays the greedy move
+    unsigned chooseReplayMove(Game<N>& game) override {
+        return getChosenMove(game, false).second;
+    }
+
+public:
+    ConvNetworkStrategy() : m_inference({filters, filters}) {
+        m_conv1.setStructure({SIZE, SIZE, CHANNELS}, {filters, 3, 3});
+        m_conv2.setStructure({SIZE, SIZE, filters}, {filters, 3, 3});
+        m_outLayer.setStructure(m_conv2.outputShape().numElements(), 1);
+        m_moveNet = m_conv1 >> m_conv2 >> m_outLayer;
+        m_inference.setParameters(m_moveNet.parameterVector());
+    }
+
+    // inputs is a RealVector or a row of an input batch: the planes of every cell of the image,
+    // cell by cell
+    template <class Input>
+    void createInput(Board<N> const& board, unsigned int activePlayer, Input&& inputs) {
+        uint8_t planes[CELLS];
+        m_encode(board, activePlayer, planes);
+        for (unsigned k = 0; k < CELLS; k++) {
+            for (unsigned c = 0; c < CHANNELS; c++) {
+                inputs(k*CHANNELS + c) = (planes[k] == c ? 1.0 : 0.0);
+            }
+        }
+    }
+
+    // the chance to win of the player to move on board
+    double evaluate(Board<N> const& board, unsigned player) {
+        uint8_t planes[CELLS];
+        m_encode(board, player, planes);
+        if (m_precision == Precision::Double) {
+            RealVector input(CELLS * CHANNELS, 0.0);
+            for (unsigned k = 0; k < CELLS; k++) {
+                if (planes[k] != Inference::NO_PLANE) { input(k*CHANNELS + planes[k]) = 1.0; }
+            }
+            return m_moveNet(input)(0);
+        }
+        return m_inference.eval(planes);
+    }
+
+    // arithmetic of the move values, Double evaluates m_moveNet itself. The kernel has no int8
+    // path, Int8 plays in float32.
+    void setPrecision(Precision precision) {
+        m_precision = precision;
+        if (m_cache) { m_cache->clear(); }
+    }
+
+    Precision precision() const {
+        return m_precision;
+    }
+
+    // value of a move: the afterstate valued from the point of view of the opponent
+    double getMoveValue(Game<N>& game, unsigned move) {
+        game.makeMove(move);
+        uint64_t hash = m_hash(game.getBoard(), game.ActivePlayer());
+        double value;
+        if (!m_cache || !m_cache->lookup(hash, value)) {
+            value = evaluate(game.getBoard(), game.ActivePlayer());
+            if (m_cache) { m_cache->store(hash, value); }
+        }
+        game.unmakeMove();
+        return value;
+    }
+
+    // the values of the afterstates of all empty cells, valid until the next call
+    std::vector<std::pair<double, int>> const& getMoveValues(Game<N>& game) {
+        unsigned num_empty = game.numEmptyCells();
+        m_move_values.resize(num_empty);
+        for (unsigned k=0; k < num_empty; k++) {
+            unsigned move = game.emptyCell(k);
+            m_move_values[k] = std::pair<double, int>(getMoveValue(game, move), move);
+        }
+        return m_move_values;
+    }
+
+    // choose an action for the active player of the game. The game is left as it was.
+    std::pair<double, int> getChosenMove(Game<N>& game, bool epsilon_greedy) {
+        std::pair<double, int> book_move;
+        if (this->bookMove(game.getBoard(), game.ActivePlayer(), book_move)) {
+            return book_move;
+        }
+        if (epsilon_greedy && shark::random::uni(currentRng(), 0.0, 1.0) < m_epsilon) {
+            unsigned move = game.randomEmptyCell();
+            return std::pair<double, int>(1 - getMoveValue(game, move), move);
+        }
+        return chooseLowestValue(getMoveValues(game));
+    }
+
+    // Caches move values by the hash of the encoded view, see TDNetworkStrategy::enableCache
+    void enableCache(unsigned log2_slots = 18) {
+        m_cache = std::make_shared<EvalCache>(log2_slots);
+    }
+
+    EvalCache const* cache() const {
+        return m_cache.get();
+    }
+
+    std::size_t numParameters() const override {
+        return m_moveNet.numberOfParameters();
+    }
+
+    void setParameters(ParameterSpan parameters) override {
+        ParameterSpan p1 = parameters.subspan(0, m_moveNet.numberOfParameters());
+        m_parameters.resize(p1.size());
+        std::copy(p1.data(), p1.data() + p1.size(), &m_parameters(0));
+        m_mask(m_parameters);
+        m_moveNet.setParameterVector(m_parameters);
+        m_inference.setParameters(m_parameters);
+        if (m_cache) { m_cache->clear(); }
+    }
+
+    // the model is a text archive, there are no inference weights
+    void modelLoaded(std::shared_ptr<float const> const&) override {
+        m_parameters = m_moveNet.parameterVector();
+        m_mask(m_parameters);
+        m_moveNet.setParameterVector(m_parameters);
+        m_inference.setParameters(m_parameters);
+        if (m_cache) { m_cache->clear(); }
+    }
+
+    ConcatenatedModel<RealVector>& GetMoveModel() override {
+        return m_moveNet;
+    };
+
+    boost::shared_ptr<State> createState() {
+        return m_moveNet.createState();
+    }
+
+    int type () override {
+        return 8;
+    }
+};
+
 // Strategies for testing
 
 /*******************\
  * Random Strategy *
 \*******************/
-class RandomStrategy : public Strategy {
+template <unsigned N>
+class RandomStrategy : public Strategy<N> {
 public:
     shark::RealVector getMoveAction(shark::blas::matrix<Tile>const&) override{
-        return shark::RealVector(BOARD_SIZE * BOARD_SIZE, 1.0);
+        return shark::RealVector(N * N, 1.0);
     }
 
     std::size_t numParameters() const override{ return 1; }
-    void setParameters(shark::RealVector const&) override{}
-    ConcatenatedModel<RealVector> GetMoveModel() override{};
+    void setParameters(ParameterSpan) override{}
 
     int type () override {
         return 4;
@@ -288,11 +938,12 @@ public:
 /******************\
  * Human Strategy *
 \******************/
-class HumanStrategy : public Strategy {
+template <unsigned N>
+class HumanStrategy : public Strategy<N> {
 private:
     bool validInput(std::string inp, std::pair<unsigned,unsigned>* pos) {
         if (inp.length() == 0) { return false; }
-        if (!((inp[0] >= 'a' && inp[0] <= ('a' + BOARD_SIZE)) || (inp[0] >= 'A' && inp[0] <= ('A' + BOARD_SIZE)))) {
+        if (!((inp[0] >= 'a' && inp[0] <= ('a' + N)) || (inp[0] >= 'A' && inp[0] <= ('A' + N)))) {
             return false;
         }
         unsigned num;
@@ -301,7 +952,7 @@ private:
         } catch (std::invalid_argument& e) {
             return false;
         }
-        if (num <= 0 || num > BOARD_SIZE) { return false; }
+        if (num <= 0 || num > N) { return false; }
         (*pos).first = num - 1;
         (*pos).second = toupper(inp[0]) - 65;
         return true;
@@ -341,15 +992,14 @@ public:
                 playerInput = "";
             }
         }
-        shark::RealVector movefield(BOARD_SIZE * BOARD_SIZE, -std::numeric_limits<double>::max());
-        movefield(pos.first * BOARD_SIZE + pos.second) = 1.0;
+        shark::RealVector movefield(N * N, -std::numeric_limits<double>::max());
+        movefield(pos.first * N + pos.second) = 1.0;
 
         return movefield;
     }
 
     std::size_t numParameters() const override{ return 1; }
-    void setParameters(shark::RealVector const&) override{}
-    ConcatenatedModel<RealVector> GetMoveModel() override{};
+    void setParameters(ParameterSpan) override{}
 
     int type () override {
         return 3;
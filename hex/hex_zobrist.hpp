@@ -0,0 +1,35 @@
+#ifndef HEX_ZOBRIST_HPP
+#define HEX_ZOBRIST_HPP
+
+#include <cstdint>
+
+namespace Hex {
+
+    // Zobrist keys for the cells of an N x N board as a player sees it: keys[0] for the player's own
+    // stones and keys[1] for the opponent's. Built at compile time with splitmix64, so hashes are the
+    // same in every run and every build.
+    template <unsigned N>
+    struct ZobristKeys {
+        uint64_t keys[2][N * N];
+
+        constexpr ZobristKeys() : keys() {
+            uint64_t state = 0x5851F42D4C957F2DULL * N;
+            for (unsigned side = 0; side < 2; side++) {
+                for (unsigned idx = 0; idx < N * N; idx++) {
+                    state += 0x9E3779B97F4A7C15ULL;
+                    uint64_t z = state;
+                    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                    keys[side][idx] = z ^ (z >> 31);
+                }
+            }
+        }
+
+        static ZobristKeys const& get() {
+            static constexpr ZobristKeys table = ZobristKeys();
+            return table;
+        }
+    };
+}
+
+#endif
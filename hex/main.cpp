@@ -1,7 +1,15 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
 #include "Hex.hpp"
 #include "hex_algorithms.hpp"
+#include "hex_playout.hpp"
+#include "hex_embedded.hpp"
+#include "hex_mcts.hpp"
+#include "hex_alphabeta.hpp"
+#include "hex_humanplay.hpp"
 
 using namespace shark;
 using namespace Hex;
@@ -25,9 +33,11 @@ struct PreviousModelGameStats {
 /******************\
  *  Base Trainer  *
 \******************/
-template <class AlgorithmType, class StrategyType>
+template <unsigned N, class AlgorithmType, class StrategyType>
 class ModelTrainer {
 public:
+    static const unsigned BOARD_SIZE = N;
+
     ModelTrainer(std::string randomStatsFilename, std::string previousModelStatsFilename) {
         boost::filesystem::path modelsdir("models/");
         boost::filesystem::create_directory(modelsdir);
@@ -56,7 +66,17 @@ public:
     virtual void saveModel(std::string modelName) = 0;
     virtual void loadModel(std::string modelName) = 0;
     size_t NumberOfEpisodes() { return m_number_of_episodes; }
-    AlgorithmType GetAlgorithm() { return m_algorithm; }
+    AlgorithmType& GetAlgorithm() { return m_algorithm; }
+
+    // appends the games played by the algorithm and against the random player to the recorder
+    void recordGames(GameRecordWriter* recorder) { m_algorithm.setRecorder(recorder); }
+
+    // precision of the networks in the games against the random player and the previous model
+    void setPlayPrecision(Precision precision) { m_play_precision = precision; }
+
+    // opening book of the example games and the games against the random player and the previous
+    // model, the games of the algorithm explore their openings without it
+    void setOpeningBook(OpeningBook<N> const* book) { m_book = book; }
 
     struct RandomGameStats GetRandomPlayStats() { return m_randomGameStats; }
 
@@ -79,6 +99,10 @@ public:
         StrategyType player1 = m_algorithm.GetStrategy();
         StrategyType player2;
         player2.loadStrategy("models/" + model);
+        player1.setPrecision(m_play_precision);
+        player2.setPrecision(m_play_precision);
+        player1.setOpeningBook(m_book);
+        player2.setOpeningBook(m_book);
 
         double total_games = 100;
         double new_model_wins = 0;
@@ -103,21 +127,15 @@ public:
     }
 
     void RandomPlayersBaseline() {
-        Game game = m_algorithm.GetGame();
-
-        RandomStrategy rPlayer1;
-        RandomStrategy rPlayer2;
-
         double total_games_played = 0;
         double player1_wins = 0;
 
         std::ofstream randomPlayersBaselineStatsOutstream("logs/randomPlayersBaseline.log");
 
+        // random games are decided by filling the board, see RandomPlayout
         for (int i=0; i < 500; i++) {
             for (int i=0; i < 100; i ++) {
-                game.reset();
-                while (game.takeStrategyTurn({&rPlayer1, &rPlayer2})) {}
-                if (game.getRank(0) == 0) {
+                if (RandomPlayout<N>::winner() == Blue) {
                     player1_wins++;
                 }
                 total_games_played++;
@@ -130,6 +148,8 @@ public:
 
 protected:
     bool m_silent = false;
+    Precision m_play_precision = Precision::Float32;
+    OpeningBook<N> const* m_book = nullptr;
 
     AlgorithmType m_algorithm;
     size_t m_number_of_episodes;
@@ -170,22 +190,34 @@ protected:
 /*********************\
  *  CSA-ES  Trainer  *
 \*********************/
-class ModelTrainerCSA : public ModelTrainer<CSAAlgorithm, CSANetworkStrategy> {
+template <unsigned N>
+class ModelTrainerCSA : public ModelTrainer<N, CSAAlgorithm<N>, CSANetworkStrategy<N>> {
 private:
-    CSANetworkStrategy m_player2;
+    typedef ModelTrainer<N, CSAAlgorithm<N>, CSANetworkStrategy<N>> Base;
+    using Base::m_silent;
+    using Base::m_algorithm;
+    using Base::m_number_of_episodes;
+    using Base::m_steps;
+    using Base::updateRandomPlayStats;
+    using Base::m_play_precision;
+    using Base::m_book;
+
+    CSANetworkStrategy<N> m_player2;
 public:
-    ModelTrainerCSA(std::string randomStatsFilename, std::string previousModelStatsFilename) : ModelTrainer(randomStatsFilename, previousModelStatsFilename) {
+    ModelTrainerCSA(std::string randomStatsFilename, std::string previousModelStatsFilename) : Base(randomStatsFilename, previousModelStatsFilename) {
         m_number_of_episodes = 50000;
         m_player2.setColor(Red);
     }
 
     void playExampleGame() override {
-        Game game = m_algorithm.GetGame();
-        CSANetworkStrategy player1 = m_algorithm.GetStrategy();
-        SelfRLCMA csa = m_algorithm.GetCSA();
+        Game<N> game = m_algorithm.GetGame();
+        CSANetworkStrategy<N> player1 = m_algorithm.GetStrategy();
+        SelfRLCMA const& csa = m_algorithm.GetCSA();
         game.reset();
         player1.setParameters(csa.mean());
         m_player2.setParameters(csa.mean());
+        player1.setOpeningBook(m_book);
+        m_player2.setOpeningBook(m_book);
         if (!m_silent) { std::cout << game.asciiState() << std::endl; }
         while (game.takeStrategyTurn({&player1, &m_player2})) {
             if (!m_silent) { std::cout << game.asciiState() << std::endl; }
@@ -197,23 +229,25 @@ public:
     }
 
     void playAgainstRandom() override {
-        RandomStrategy random_player;
-        Game game = m_algorithm.GetGame();
-        CSANetworkStrategy player1 = m_algorithm.GetStrategy();
-        SelfRLCMA csa = m_algorithm.GetCSA();
+        RandomStrategy<N> random_player;
+        Game<N> game = m_algorithm.GetGame();
+        CSANetworkStrategy<N> player1 = m_algorithm.GetStrategy();
+        SelfRLCMA const& csa = m_algorithm.GetCSA();
 
         game.reset();
         player1.setParameters(csa.mean());
+        player1.setPrecision(m_play_precision);
+        player1.setOpeningBook(m_book);
         while (game.takeStrategyTurn({&player1, &random_player})) { }
         updateRandomPlayStats(game.getRank(Blue));
     }
 
 
-    int playGameWithStrategies(std::vector<CSANetworkStrategy*> const& strategies) override {
-        Game game;
+    int playGameWithStrategies(std::vector<CSANetworkStrategy<N>*> const& strategies) override {
+        Game<N> game;
         game.reset();
-        CSANetworkStrategy* ESplayer1 = (CSANetworkStrategy*)strategies[0];
-        CSANetworkStrategy* ESplayer2 = (CSANetworkStrategy*)strategies[1];
+        CSANetworkStrategy<N>* ESplayer1 = (CSANetworkStrategy<N>*)strategies[0];
+        CSANetworkStrategy<N>* ESplayer2 = (CSANetworkStrategy<N>*)strategies[1];
         while (game.takeStrategyTurn({ESplayer1, ESplayer2})) {}
         if (game.getRank(0) == 0) {
             return 1;
@@ -265,16 +299,30 @@ public:
 /******************\
  *  TD   Trainer  *
 \******************/
-class ModelTrainerTD : public ModelTrainer<TDAlgorithm, TDNetworkStrategy> {
+// of a value network, TDNetworkStrategy or ConvNetworkStrategy
+template <unsigned N, class StrategyType = TDNetworkStrategy<N>>
+class ModelTrainerTD : public ModelTrainer<N, TDAlgorithm<N, StrategyType>, StrategyType> {
+private:
+    typedef ModelTrainer<N, TDAlgorithm<N, StrategyType>, StrategyType> Base;
+    using Base::m_silent;
+    using Base::m_algorithm;
+    using Base::m_number_of_episodes;
+    using Base::m_steps;
+    using Base::updateRandomPlayStats;
+    using Base::m_play_precision;
+    using Base::m_book;
 public:
-    ModelTrainerTD(std::string randomStatsFilename, std::string previousModelStatsFilename) : ModelTrainer(randomStatsFilename, previousModelStatsFilename) {
+    ModelTrainerTD(std::string randomStatsFilename, std::string previousModelStatsFilename) : Base(randomStatsFilename, previousModelStatsFilename) {
         m_number_of_episodes = 50000;
     }
 
     void playExampleGame() override {
-        Game game = m_algorithm.GetGame();
-        TDNetworkStrategy TDplayer1 = m_algorithm.GetStrategy();
+        Game<N> game = m_algorithm.GetGame();
+        StrategyType TDplayer1 = m_algorithm.GetStrategy();
+        TDplayer1.setOpeningBook(m_book);
         game.reset();
+        game.setStrategyType(Blue, TDplayer1.type());
+        game.setStrategyType(Red, TDplayer1.type());
         if (!m_silent) { std::cout << game.asciiState() << std::endl; }
         bool won = false;
         unsigned state = 0;
@@ -290,10 +338,13 @@ public:
     }
 
     void playAgainstRandom() override {
-        RandomStrategy random_player;
-        TDNetworkStrategy TDplayer1 = m_algorithm.GetStrategy();
-        Game game = m_algorithm.GetGame();
+        RandomStrategy<N> random_player;
+        StrategyType TDplayer1 = m_algorithm.GetStrategy();
+        TDplayer1.setPrecision(m_play_precision);
+        TDplayer1.setOpeningBook(m_book);
+        Game<N> game = m_algorithm.GetGame();
         game.reset();
+        game.setStrategyType(Blue, TDplayer1.type());
 
         bool won = false;
         while (!won) {
@@ -307,12 +358,12 @@ public:
         updateRandomPlayStats(game.getRank(Blue));
     }
 
-    int playGameWithStrategies(std::vector<TDNetworkStrategy*> const& strategies) override {
-        Game game;
+    int playGameWithStrategies(std::vector<StrategyType*> const& strategies) override {
+        Game<N> game;
         game.reset();
         bool won = false;
-        TDNetworkStrategy* TDplayer1 = (TDNetworkStrategy*)strategies[0];
-        TDNetworkStrategy* TDplayer2 = (TDNetworkStrategy*)strategies[1];
+        StrategyType* TDplayer1 = (StrategyType*)strategies[0];
+        StrategyType* TDplayer2 = (StrategyType*)strategies[1];
         while (!won) {
             std::pair<double, int> chosen_move;
             if (game.ActivePlayer() == Blue) {
@@ -331,7 +382,7 @@ public:
 
     //void playAgainstModel(std::string model) override {
     //    // initialize players with models
-    //    TDNetworkStrategy TDplayer1 = m_algorithm.GetStrategy();
+    //    TDNetworkStrategy<N> TDplayer1 = m_algorithm.GetStrategy();
     //    TDNetworkStrategy TDplayer2;
     //    TDplayer2.loadStrategy(model);
     //    Game game;
@@ -356,6 +407,95 @@ public:
     //    std::cout << winrate << " newest model winrate in " << total_games << " games played against previous model.";
     //}
 
+    void printTrainingStatus() override {
+        std::cout << "Step " << m_steps << std::endl;
+        EvalCache const* cache = m_algorithm.GetStrategy().cache();
+        if (cache) {
+            std::cout << "Eval cache hit rate: " << cache->hitRate() << " (" << cache->hits() << "/" << cache->lookups() << ")" << std::endl;
+        }
+    }
+
+    void step() override {
+        m_algorithm.EpisodeStep(m_steps);
+        m_steps++;
+    }
+
+    void saveModel(std::string modelName) override {
+        m_algorithm.GetStrategy().saveStrategy("models/" + modelName);
+    }
+
+    void loadModel(std::string modelName) override {
+        m_algorithm.GetStrategy().loadStrategy("models/" + modelName);
+    }
+};
+
+
+/*********************************\
+ *  Policy and Value  Trainer    *
+\*********************************/
+// The example games sample the moves of the policy through Game::takeStrategyTurn, the games
+// against the random player and the previous model play its most likely moves
+template <unsigned N>
+class ModelTrainerDualHead : public ModelTrainer<N, DualHeadAlgorithm<N>, DualHeadStrategy<N>> {
+private:
+    typedef ModelTrainer<N, DualHeadAlgorithm<N>, DualHeadStrategy<N>> Base;
+    using Base::m_silent;
+    using Base::m_algorithm;
+    using Base::m_number_of_episodes;
+    using Base::m_steps;
+    using Base::updateRandomPlayStats;
+    using Base::m_play_precision;
+    using Base::m_book;
+public:
+    ModelTrainerDualHead(std::string randomStatsFilename, std::string previousModelStatsFilename) : Base(randomStatsFilename, previousModelStatsFilename) {
+        m_number_of_episodes = 50000;
+    }
+
+    void playExampleGame() override {
+        Game<N> game = m_algorithm.GetGame();
+        DualHeadStrategy<N> player1 = m_algorithm.GetStrategy();
+        player1.setOpeningBook(m_book);
+        game.reset();
+        if (!m_silent) { std::cout << game.asciiState() << std::endl; }
+        while (game.takeStrategyTurn({&player1, &player1})) {
+            if (!m_silent) { std::cout << game.asciiState() << std::endl; }
+        }
+        if (!m_silent) {
+            std::cout << game.asciiState() << std::endl;
+            std::cout << "End of example game." << std::endl;
+        }
+    }
+
+    void playAgainstRandom() override {
+        RandomStrategy<N> random_player;
+        DualHeadStrategy<N> player1 = m_algorithm.GetStrategy();
+        player1.setPrecision(m_play_precision);
+        player1.setOpeningBook(m_book);
+        Game<N> game = m_algorithm.GetGame();
+        game.reset();
+        game.setStrategyType(Blue, player1.type());
+
+        bool won = false;
+        while (!won) {
+            if (game.ActivePlayer() == Blue) {
+                won = !game.takeTurn(player1.getChosenMove(game, false).second);
+            } else {
+                won = !game.takeStrategyTurn({NULL, &random_player});
+            }
+        }
+        updateRandomPlayStats(game.getRank(Blue));
+    }
+
+    int playGameWithStrategies(std::vector<DualHeadStrategy<N>*> const& strategies) override {
+        Game<N> game;
+        game.reset();
+        bool won = false;
+        while (!won) {
+            won = !game.takeTurn(strategies[game.ActivePlayer()]->getChosenMove(game, false).second);
+        }
+        return game.getRank(0) == 0 ? 1 : 0;
+    }
+
     void printTrainingStatus() override {
         std::cout << "Step " << m_steps << std::endl;
     }
@@ -379,9 +519,13 @@ public:
  *  Training Loop  *
 \*******************/
 template<class TrainerType>
-void trainingLoop(std::string modelName) {
-    std::string prefix = modelName + std::to_string(BOARD_SIZE) + "x" + std::to_string(BOARD_SIZE);
+void trainingLoop(std::string modelName, GameRecordWriter* recorder, Precision precision,
+                  OpeningBook<TrainerType::BOARD_SIZE> const* book) {
+    std::string prefix = modelName + std::to_string(TrainerType::BOARD_SIZE) + "x" + std::to_string(TrainerType::BOARD_SIZE);
     TrainerType trainer(prefix + "randomStats", prefix + "previousModelStats");
+    trainer.recordGames(recorder);
+    trainer.setPlayPrecision(precision);
+    trainer.setOpeningBook(book);
 
     // Uncomment to create random players baseline
     //trainer.RandomPlayersBaseline();
@@ -426,122 +570,1113 @@ void trainingLoop(std::string modelName) {
 /********************\
  *  For python app  *
 \********************/
-void initializePythonSettings() {
-    std::cout << "__MODEL_GOOD__" << std::endl;
-    std::string response = "";
-    std::getline(std::cin, response);
-    std::cout << "__BOARD_SIZE__ " << BOARD_SIZE << std::endl;
+// The games against a human are played by playAgainstHuman, see hex_humanplay.hpp.
+
+// a strategy that chooses its moves with getChosenMove(game, false), a TD or a policy and value
+// network, against a human
+template <unsigned N, class StrategyType = TDNetworkStrategy<N>>
+void playHexTDVsHuman(std::string model, bool for_python, Precision precision, OpeningBook<N> const* book) {
+    StrategyType player1;
+    if (model.length()) {
+        player1.loadStrategy(model);
+    }
+    player1.setPrecision(precision);
+    player1.setOpeningBook(book);
+    playAgainstHuman<N>(for_python, [&](Game<N>& game) { return player1.getChosenMove(game, false).second; });
 }
 
-void playHexTDVsHuman(std::string model, bool for_python) {
-    HumanStrategy human_player(for_python);
-    TDNetworkStrategy TDplayer1;
+// a searching strategy, MCTSStrategy or AlphaBetaStrategy, against a human
+template <unsigned N, class SearchType, class Options>
+void playHexSearchVsHuman(std::string model, bool for_python, Precision precision, Options const& options,
+                          OpeningBook<N> const* book) {
+    SearchType searchPlayer1;
     if (model.length()) {
-        TDplayer1.loadStrategy(model);
+        searchPlayer1.loadStrategy(model);
+    }
+    searchPlayer1.setPrecision(precision);
+    searchPlayer1.setOptions(options);
+    searchPlayer1.setOpeningBook(book);
+    playAgainstHuman<N>(for_python, [&](Game<N>& game) { return searchPlayer1.getChosenMove(game).second; });
+}
+
+// a CSA-ES network against a human, sampling its moves like Game::takeStrategyTurn
+template <unsigned N>
+void playHexCSAVsHuman(std::string model, bool for_python, Precision precision, OpeningBook<N> const* book) {
+    CSANetworkStrategy<N> CSAplayer1;
+    if (model.length()) {
+        CSAplayer1.loadStrategy(model);
+    }
+    CSAplayer1.setPrecision(precision);
+    CSAplayer1.setOpeningBook(book);
+    playAgainstHuman<N>(for_python, [&](Game<N>& game) { return game.chooseStrategyMove(CSAplayer1); });
+}
+
+
+/****************\
+ *  Benchmarks  *
+\****************/
+// Random games as (start position, moves), so that benchmarked variants visit the same positions.
+template <unsigned N>
+std::vector<std::pair<Game<N>, std::vector<unsigned>>> recordRandomGames(std::size_t total_games) {
+    std::vector<std::pair<Game<N>, std::vector<unsigned>>> games;
+    for (std::size_t g=0; g < total_games; g++) {
+        Game<N> start;
+        start.reset();
+        Game<N> game = start;
+        std::vector<unsigned> moves;
+        bool running = true;
+        while (running) {
+            unsigned move = game.randomEmptyCell();
+            moves.push_back(move);
+            running = game.takeTurn(move);
+        }
+        games.push_back(std::make_pair(start, moves));
+    }
+    return games;
+}
+
+// Plies per second of a one-ply lookahead over every empty cell of the positions of random games.
+// "copy" copies the game and builds the rotated tile matrix per candidate, the way the strategies
+// used to look ahead. "make/unmake" plays and takes back each candidate on the game itself.
+template <unsigned N>
+void benchmarkLookahead() {
+    RandomStrategy<N> rPlayer;
+
+    std::size_t total_games = 2000;
+    auto games = recordRandomGames<N>(total_games);
+
+    for (int variant=0; variant < 2; variant++) {
+        std::size_t plies = 0;
+        std::size_t wins = 0;
+        // printed, so the copied views are not optimized away
+        std::size_t empty_corners = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        for (std::size_t g=0; g < total_games; g++) {
+            Game<N> game = games[g].first;
+            for (unsigned move : games[g].second) {
+                for (unsigned i=0; i < N*N; i++) {
+                    if (!game.getBoard().empty(i)) { continue; }
+                    if (variant == 0) {
+                        Game<N> copy = game;
+                        wins += !copy.takeTurn(i);
+                        blas::matrix<Tile> field = rPlayer.rotateField(copy.getGameBoard(), false);
+                        empty_corners += field(0, 0).tileState == Empty;
+                    } else {
+                        wins += game.makeMove(i);
+                        game.unmakeMove();
+                    }
+                    plies++;
+                }
+                game.takeTurn(move);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << (variant == 0 ? "copy:        " : "make/unmake: ")
+                  << plies / seconds << " plies/sec (" << plies << " plies, " << wins << " winning";
+        if (variant == 0) {
+            std::cout << ", " << empty_corners << " with an empty corner";
+        }
+        std::cout << ")" << std::endl;
+    }
+}
+
+// Plies per second of the same one-ply make/unmake lookahead with each way of detecting wins.
+// Both have to find the same number of winning moves.
+template <unsigned N>
+void benchmarkWinDetection() {
+    std::size_t total_games = 2000;
+    auto games = recordRandomGames<N>(total_games);
+
+    const WinDetection methods[2] = {WinDetection::UnionFind, WinDetection::FloodFill};
+    for (WinDetection method : methods) {
+        std::size_t plies = 0;
+        std::size_t wins = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        for (std::size_t g=0; g < total_games; g++) {
+            Game<N> game = games[g].first;
+            game.setWinDetection(method);
+            for (unsigned move : games[g].second) {
+                for (unsigned k=0; k < game.numEmptyCells(); k++) {
+                    wins += game.makeMove(game.emptyCell(k));
+                    game.unmakeMove();
+                    plies++;
+                }
+                game.takeTurn(move);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << N << "x" << N << (method == WinDetection::UnionFind ? " union-find: " : " flood fill: ")
+                  << plies / seconds << " plies/sec (" << plies << " plies, " << wins << " winning)" << std::endl;
     }
-    Game game;
-    game.reset();
-    if (for_python) {
-        initializePythonSettings();
-        std::cout << game.asciiStatePython() << std::endl;
+}
+
+// Random games per second: played move by move on a Game, in lockstep on a GameBatch, and decided
+// by a fill-the-board RandomPlayout. All three should give the same blue winrate.
+template <unsigned N>
+void benchmarkRandomPlayouts() {
+    std::size_t total_games = 200000;
+    for (int variant=0; variant < 3; variant++) {
+        std::size_t blue_wins = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        if (variant == 0) {
+            Game<N> game;
+            for (std::size_t g=0; g < total_games; g++) {
+                game.reset();
+                while (game.takeTurn(game.randomEmptyCell())) {}
+                blue_wins += game.getRank(Blue) == 0;
+            }
+        } else if (variant == 1) {
+            GameBatch<N> batch(1000, total_games);
+            std::vector<unsigned> moves(batch.size());
+            while (!batch.done()) {
+                for (std::size_t g=0; g < batch.size(); g++) {
+                    if (batch.running(g)) { moves[g] = batch.randomEmptyCell(g); }
+                }
+                batch.step(moves.data());
+            }
+            blue_wins = batch.wins(Blue);
+        } else {
+            for (std::size_t g=0; g < total_games; g++) {
+                blue_wins += RandomPlayout<N>::winner() == Blue;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        const char* names[3] = {"game:    ", "batch:   ", "playout: "};
+        std::cout << N << "x" << N << " " << names[variant] << total_games / seconds << " games/sec (blue winrate "
+                  << double(blue_wins) / total_games << ")" << std::endl;
+    }
+}
+
+
+/***************\
+ *  Inference  *
+\***************/
+// Compares the float32 inference engine of a strategy with its Shark network on the encoded positions
+// of random games and times both. Without a model file the weights are random. Returns 1 if an
+// output differs by more than float rounding can explain.
+template <unsigned N, class StrategyType>
+int checkInferenceParity(std::string model) {
+    StrategyType strategy;
+    if (model.length() > 0) {
+        strategy.loadStrategy("models/" + model);
     } else {
-        std::cout << game.asciiState() << std::endl;
+        RealVector parameters = blas::normal(currentRng(), strategy.numParameters(), 0.0, 1.0/(N*N), blas::cpu_tag());
+        strategy.setParameters(parameters);
+    }
+    ConcatenatedModel<RealVector>& network = strategy.GetMoveModel();
+    MLPInference const& inference = strategy.inference();
+
+    // both players' views of every position of the games
+    TDNetworkStrategy<N> encoder;
+    std::vector<RealVector> inputs;
+    for (auto& recorded : recordRandomGames<N>(200)) {
+        Game<N> game = recorded.first;
+        for (unsigned move : recorded.second) {
+            for (unsigned player = 0; player < 2; player++) {
+                inputs.push_back(RealVector(N*N));
+                encoder.createInput(game.getBoard(), player, inputs.back());
+            }
+            game.takeTurn(move);
+        }
+    }
+    std::vector<float> floatInputs(inputs.size() * N*N);
+    for (std::size_t k = 0; k < inputs.size(); k++) {
+        for (unsigned i = 0; i < N*N; i++) {
+            floatInputs[k*N*N + i] = float(inputs[k](i));
+        }
     }
 
-    bool won = false;
-    while (!won) {
-        if (game.ActivePlayer() == Blue) {
-            std::pair<double, int> chosen_move = TDplayer1.getChosenMove(game, false);
-            won = !game.takeTurn(chosen_move.second);
+    std::size_t outputs = inference.outputSize();
+    std::vector<RealVector> expected(inputs.size());
+    auto start_time = std::chrono::steady_clock::now();
+    for (std::size_t k = 0; k < inputs.size(); k++) {
+        network.eval(inputs[k], expected[k]);
+    }
+    double sharkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    std::vector<float> actual(inputs.size() * outputs);
+    start_time = std::chrono::steady_clock::now();
+    inference.eval(floatInputs.data(), inputs.size(), actual.data());
+    double inferenceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    // the same inputs as lists of the 1 and -1 entries, the way the strategies pass boards
+    std::vector<std::vector<unsigned>> plus(inputs.size()), minus(inputs.size());
+    for (std::size_t k = 0; k < inputs.size(); k++) {
+        for (unsigned i = 0; i < N*N; i++) {
+            if (inputs[k](i) > 0) { plus[k].push_back(i); }
+            if (inputs[k](i) < 0) { minus[k].push_back(i); }
+        }
+    }
+    std::vector<float> actualSparse(inputs.size() * outputs);
+    start_time = std::chrono::steady_clock::now();
+    for (std::size_t k = 0; k < inputs.size(); k++) {
+        float const* result = inference.evalSparse(plus[k].data(), plus[k].size(), minus[k].data(), minus[k].size());
+        std::copy(result, result + outputs, actualSparse.begin() + k*outputs);
+    }
+    double sparseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    std::cout << inputs.size() << " positions, " << outputs << " outputs each" << std::endl;
+    std::cout << "Shark:     " << inputs.size() / sharkSeconds << " evals/sec" << std::endl;
+    std::size_t failures = 0;
+    for (int variant = 0; variant < 2; variant++) {
+        std::vector<float> const& result = (variant == 0 ? actual : actualSparse);
+        double maxError = 0, sumError = 0;
+        std::size_t variantFailures = 0;
+        for (std::size_t k = 0; k < inputs.size(); k++) {
+            // move preferences only matter relative to each other, so the tolerance scales with the largest one
+            double scale = 1;
+            for (std::size_t o = 0; o < outputs; o++) {
+                scale = std::max(scale, std::abs(expected[k](o)));
+            }
+            for (std::size_t o = 0; o < outputs; o++) {
+                double error = std::abs(result[k*outputs + o] - expected[k](o));
+                maxError = std::max(maxError, error);
+                sumError += error;
+                variantFailures += error > 1e-4 * scale;
+            }
+        }
+        std::cout << (variant == 0 ? "inference: " : "sparse:    ")
+                  << inputs.size() / (variant == 0 ? inferenceSeconds : sparseSeconds) << " evals/sec, max abs error "
+                  << maxError << ", mean abs error " << sumError / (inputs.size() * outputs)
+                  << ", outputs out of tolerance: " << variantFailures << std::endl;
+        failures += variantFailures;
+    }
+    return failures > 0;
+}
+
+
+/******************\
+ *  Quantization  *
+\******************/
+// The move a TD strategy plays, or the most likely move of a CSA strategy, which samples its moves
+template <unsigned N>
+unsigned preferredMove(TDNetworkStrategy<N>& strategy, Game<N>& game) {
+    return strategy.getChosenMove(game, false).second;
+}
+
+template <unsigned N>
+unsigned preferredMove(CSANetworkStrategy<N>& strategy, Game<N>& game) {
+    bool rotated = game.ActivePlayer() == Red;
+    strategy.setColor(game.ActivePlayer());
+    RealVector response = strategy.getMoveAction(BoardView<N>(game.getBoard(), rotated));
+    uint8_t const* toView = (rotated ? RotationTable<N>::get().toView : RotationTable<N>::get().identity);
+    unsigned best = game.emptyCell(0);
+    for (unsigned k = 1; k < game.numEmptyCells(); k++) {
+        if (response(toView[game.emptyCell(k)]) > response(toView[best])) {
+            best = game.emptyCell(k);
+        }
+    }
+    return best;
+}
+
+// plays a move of the strategy for the active player, returns false if it won
+template <unsigned N>
+bool playStrategyMove(TDNetworkStrategy<N>& strategy, Game<N>& game) {
+    return game.takeTurn(strategy.getChosenMove(game, false).second);
+}
+
+template <unsigned N>
+bool playStrategyMove(CSANetworkStrategy<N>& strategy, Game<N>& game) {
+    strategy.setColor(game.ActivePlayer());
+    return game.takeStrategyTurn({&strategy, &strategy});
+}
+
+// Plays a model in double, float32 and int8 precision: how often the preferred moves of float32 and
+// int8 agree with double on the positions of random games, how fast they are, how often each wins
+// against the random player, and how int8 does against double. Without a model the weights are random.
+template <unsigned N, class StrategyType>
+void reportQuantization(std::string model) {
+    const Precision precisions[3] = {Precision::Double, Precision::Float32, Precision::Int8};
+    const char* names[3] = {"double: ", "float32:", "int8:   "};
+    StrategyType strategies[3];
+    RealVector parameters;
+    if (model.length() == 0) {
+        parameters = blas::normal(currentRng(), strategies[0].numParameters(), 0.0, 1.0/(N*N), blas::cpu_tag());
+    }
+    for (int p = 0; p < 3; p++) {
+        if (model.length() > 0) {
+            strategies[p].loadStrategy(model);
         } else {
-            won = !game.takeStrategyTurn({NULL, &human_player});
+            strategies[p].setParameters(parameters);
+        }
+        strategies[p].setPrecision(precisions[p]);
+    }
+
+    // preferred moves on the positions of random games
+    auto games = recordRandomGames<N>(500);
+    std::size_t positions = 0;
+    std::size_t agreements[3] = {0, 0, 0};
+    double seconds[3] = {0, 0, 0};
+    std::vector<unsigned> reference;
+    for (int p = 0; p < 3; p++) {
+        std::size_t k = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        for (auto& recorded : games) {
+            Game<N> game = recorded.first;
+            for (unsigned move : recorded.second) {
+                unsigned preferred = preferredMove(strategies[p], game);
+                if (p == 0) {
+                    reference.push_back(preferred);
+                } else {
+                    agreements[p] += preferred == reference[k];
+                }
+                k++;
+                game.takeTurn(move);
+            }
+        }
+        seconds[p] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        positions = k;
+    }
+
+    // the strategy plays blue against the random player
+    std::size_t total_games = 1000;
+    double winrates[3];
+    for (int p = 0; p < 3; p++) {
+        std::size_t wins = 0;
+        Game<N> game;
+        for (std::size_t g = 0; g < total_games; g++) {
+            game.reset();
+            bool running = true;
+            while (running) {
+                running = (game.ActivePlayer() == Blue ? playStrategyMove(strategies[p], game)
+                                                       : game.takeTurn(game.randomEmptyCell()));
+            }
+            wins += game.getRank(Blue) == 0;
+        }
+        winrates[p] = double(wins) / total_games;
+    }
+
+    // int8 against double, with colors alternating. Both play greedily, so the games open with
+    // a random move of each player to not repeat the same few games.
+    std::size_t int8_wins = 0;
+    Game<N> game;
+    for (std::size_t g = 0; g < total_games; g++) {
+        unsigned int8_color = g % 2;
+        game.reset();
+        game.takeTurn(game.randomEmptyCell());
+        game.takeTurn(game.randomEmptyCell());
+        bool running = true;
+        while (running) {
+            running = playStrategyMove(strategies[game.ActivePlayer() == int8_color ? 2 : 0], game);
         }
-        std::cout << (for_python ? game.asciiStatePython() : game.asciiState()) << std::endl;
+        int8_wins += game.getRank(int8_color) == 0;
+    }
 
+    std::cout << positions << " positions of random games, " << total_games << " games per winrate" << std::endl;
+    for (int p = 0; p < 3; p++) {
+        std::cout << names[p] << " " << positions / seconds[p] << " moves/sec";
+        if (p > 0) {
+            std::cout << ", same move as double: " << double(agreements[p]) / positions;
+        }
+        std::cout << ", winrate against random: " << winrates[p] << std::endl;
     }
-    if (for_python) {
-        std::cout << game.asciiStatePython() << std::endl;
-        std::cout << "__GAME_OVER__ " << (game.getRank(0) == 0 ? 0 : 1) << std::endl;
+    std::cout << "int8 winrate against double: " << double(int8_wins) / total_games << std::endl;
+}
+
+
+/************\
+ *  Search  *
+\************/
+// A searching strategy and the greedy TD player with the weights of the model, random without one
+template <unsigned N, class SearchType>
+void loadSearchPlayers(std::string model, Precision precision, SearchType& search, TDNetworkStrategy<N>& greedy) {
+    if (model.length() > 0) {
+        search.loadStrategy(model);
+        greedy.loadStrategy(model);
     } else {
-        std::cout << game.asciiState() << std::endl;
-        std::cout << "Game over. Player " << (game.getRank(0) == 0 ? 1 : 2) << " won!" << std::endl;
+        RealVector parameters = blas::normal(currentRng(), greedy.numParameters(), 0.0, 1.0/(N*N), blas::cpu_tag());
+        search.setParameters(parameters);
+        greedy.setParameters(parameters);
     }
+    search.setPrecision(precision);
+    greedy.setPrecision(precision);
 }
 
-void playHexCSAVsHuman(std::string model, bool for_python) {
-    HumanStrategy human_player(for_python);
-    CSANetworkStrategy CSAplayer1;
-    if (model.length()) {
-        CSAplayer1.loadStrategy(model);
+// the positions of random games after a few moves
+template <unsigned N>
+std::vector<Game<N>> searchPositions(std::size_t total_positions) {
+    std::vector<Game<N>> positions;
+    for (auto& recorded : recordRandomGames<N>(total_positions)) {
+        Game<N> game = recorded.first;
+        for (unsigned k = 0; k < std::min<std::size_t>(4, recorded.second.size() - 1); k++) {
+            game.takeTurn(recorded.second[k]);
+        }
+        positions.push_back(game);
     }
-    Game game;
-    game.reset();
-    if (for_python) {
-        initializePythonSettings();
-        std::cout << game.asciiStatePython() << std::endl;
+    return positions;
+}
+
+// Games of a searching strategy against the greedy TD player, with colors alternating. Both play
+// deterministically, so the games open with a random move of each player. searched() is called
+// after every move of the search. Returns the number of games it won.
+template <unsigned N, class SearchType, class Searched>
+std::size_t playAgainstGreedyTD(SearchType& search, TDNetworkStrategy<N>& greedy, std::size_t total_games,
+                                Searched&& searched) {
+    std::size_t wins = 0;
+    Game<N> game;
+    for (std::size_t g = 0; g < total_games; g++) {
+        unsigned search_color = g % 2;
+        game.reset();
+        game.takeTurn(game.randomEmptyCell());
+        game.takeTurn(game.randomEmptyCell());
+        bool running = true;
+        while (running) {
+            if (game.ActivePlayer() == search_color) {
+                running = game.takeTurn(search.getChosenMove(game).second);
+                searched();
+            } else {
+                running = game.takeTurn(greedy.getChosenMove(game, false).second);
+            }
+        }
+        wins += game.getRank(search_color) == 0;
+    }
+    return wins;
+}
+
+// Simulations per second of the search for each thread count up to --threads, or up to one per
+// core without it, and how it does against the greedy TD player of the same model.
+template <unsigned N>
+void reportMCTS(std::string model, Precision precision, MCTSOptions const& options) {
+    MCTSStrategy<N> mcts;
+    TDNetworkStrategy<N> greedy;
+    loadSearchPlayers(model, precision, mcts, greedy);
+
+    std::vector<Game<N>> positions = searchPositions<N>(20);
+    std::vector<unsigned> thread_counts;
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned max_threads = (options.threads ? options.threads : cores);
+    for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+    std::cout << cores << (cores == 1 ? " core" : " cores") << std::endl;
+    double single = 0;
+    for (unsigned threads : thread_counts) {
+        MCTSOptions scaling = options;
+        scaling.threads = threads;
+        mcts.setOptions(scaling);
+        std::size_t simulations = 0;
+        double seconds = 0;
+        for (Game<N>& position : positions) {
+            mcts.getChosenMove(position);
+            simulations += mcts.lastSearch().simulations;
+            seconds += mcts.lastSearch().seconds;
+        }
+        if (threads == 1) {
+            single = simulations / seconds;
+        }
+        std::cout << threads << (threads == 1 ? " thread:  " : " threads: ") << simulations / seconds
+                  << " simulations/sec, speedup " << simulations / seconds / single << std::endl;
+    }
+
+    mcts.setOptions(options);
+    std::size_t total_games = 100;
+    std::size_t moves = 0, simulations = 0;
+    double seconds = 0;
+    std::size_t wins = playAgainstGreedyTD(mcts, greedy, total_games, [&]() {
+        simulations += mcts.lastSearch().simulations;
+        seconds += mcts.lastSearch().seconds;
+        moves++;
+    });
+    std::cout << "MCTS winrate against greedy TD: " << double(wins) / total_games << " in " << total_games
+              << " games, " << simulations / double(moves) << " simulations and " << seconds / moves * 1000
+              << " ms per move" << std::endl;
+}
+
+// Nodes per second, time per move and transposition table hits of each depth up to the one of the
+// options, or up to the first one that does not complete in the time per move, and how the search
+// does against the greedy TD player of the same model.
+template <unsigned N>
+void reportAlphaBeta(std::string model, Precision precision, AlphaBetaOptions const& options) {
+    AlphaBetaStrategy<N> search;
+    TDNetworkStrategy<N> greedy;
+    loadSearchPlayers(model, precision, search, greedy);
+
+    std::vector<Game<N>> positions = searchPositions<N>(20);
+    for (unsigned depth = 1; depth <= options.max_depth; depth++) {
+        AlphaBetaOptions fixed = options;
+        fixed.max_depth = depth;
+        search.setOptions(fixed);
+        search.clearTable();
+        std::size_t nodes = 0, probes = 0, hits = 0;
+        double seconds = 0;
+        bool completed = true;
+        for (Game<N>& position : positions) {
+            search.getChosenMove(position);
+            completed = completed && !search.lastSearch().out_of_time;
+            nodes += search.lastSearch().nodes;
+            probes += search.lastSearch().probes;
+            hits += search.lastSearch().hits;
+            seconds += search.lastSearch().seconds;
+        }
+        std::cout << "depth " << depth << ": " << nodes / seconds << " nodes/sec, " << nodes / positions.size()
+                  << " nodes and " << seconds / positions.size() * 1000 << " ms per move, table hits "
+                  << (probes ? double(hits) / probes : 0.0) << std::endl;
+        if (!completed) {
+            std::cout << "depth " << depth << " does not complete in " << options.milliseconds << " ms" << std::endl;
+            break;
+        }
+    }
+
+    search.setOptions(options);
+    search.clearTable();
+    std::size_t total_games = 100;
+    std::size_t moves = 0, nodes = 0, depths = 0;
+    double seconds = 0;
+    std::size_t wins = playAgainstGreedyTD(search, greedy, total_games, [&]() {
+        nodes += search.lastSearch().nodes;
+        depths += search.lastSearch().depth;
+        seconds += search.lastSearch().seconds;
+        moves++;
+    });
+    std::cout << "alpha-beta winrate against greedy TD: " << double(wins) / total_games << " in " << total_games
+              << " games, depth " << double(depths) / moves << ", " << nodes / seconds << " nodes/sec and "
+              << seconds / moves * 1000 << " ms per move" << std::endl;
+}
+
+
+/**********************\
+ *  Policy and value  *
+\**********************/
+// Moves per second of the policy and value network, one pass per move, and of the greedy TD player,
+// which values the afterstate of every empty cell, on the positions of random games. Then episodes
+// per second of self-play training with either, and how the policy and value model does against the
+// random player. Without a model the weights are random; the TD weights always are.
+template <unsigned N>
+void reportDualHead(std::string model, Precision precision) {
+    DualHeadStrategy<N> dual;
+    TDNetworkStrategy<N> greedy;
+    if (model.length() > 0) {
+        dual.loadStrategy(model);
     } else {
-        std::cout << game.asciiState() << std::endl;
+        dual.setParameters(RealVector(blas::normal(currentRng(), dual.numParameters(), 0.0, 1.0/(N*N), blas::cpu_tag())));
+    }
+    greedy.setParameters(RealVector(blas::normal(currentRng(), greedy.numParameters(), 0.0, 1.0/(N*N), blas::cpu_tag())));
+    dual.setPrecision(precision);
+    greedy.setPrecision(precision);
+
+    std::size_t total_games = 500;
+    auto games = recordRandomGames<N>(total_games);
+    double moves_per_second[2];
+    for (int variant = 0; variant < 2; variant++) {
+        // the sum of the chosen moves is printed, which also keeps them from being optimized away
+        std::size_t moves = 0, afterstates = 0, move_sum = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        for (std::size_t g = 0; g < total_games; g++) {
+            Game<N> game = games[g].first;
+            for (unsigned move : games[g].second) {
+                if (variant == 0) {
+                    move_sum += greedy.getChosenMove(game, false).second;
+                } else {
+                    move_sum += dual.getChosenMove(game, false).second;
+                }
+                afterstates += game.numEmptyCells();
+                moves++;
+                game.takeTurn(move);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        moves_per_second[variant] = moves / seconds;
+        if (variant == 0) {
+            std::cout << "greedy TD:        " << moves / seconds << " moves/sec, " << double(afterstates) / moves
+                      << " afterstates per move, move sum " << move_sum << std::endl;
+        } else {
+            std::cout << "policy and value: " << moves / seconds << " moves/sec, speedup "
+                      << moves_per_second[1] / moves_per_second[0] << ", move sum " << move_sum << std::endl;
+        }
     }
 
-    while (game.takeStrategyTurn({&CSAplayer1, &human_player})) {
-        std::cout << (for_python ? game.asciiStatePython() : game.asciiState()) << std::endl;
+    // the training step included, which evaluates and differentiates the Shark network
+    std::size_t episodes = 200;
+    TDAlgorithm<N> td_algorithm;
+    DualHeadAlgorithm<N> dual_algorithm;
+    double episodes_per_second[2];
+    for (int variant = 0; variant < 2; variant++) {
+        auto start_time = std::chrono::steady_clock::now();
+        for (std::size_t e = 0; e < episodes; e++) {
+            if (variant == 0) {
+                td_algorithm.EpisodeStep(e);
+            } else {
+                dual_algorithm.EpisodeStep(e);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        episodes_per_second[variant] = episodes / seconds;
     }
+    std::cout << "TD self-play:               " << episodes_per_second[0] << " episodes/sec" << std::endl;
+    std::cout << "policy and value self-play: " << episodes_per_second[1] << " episodes/sec, speedup "
+              << episodes_per_second[1] / episodes_per_second[0] << std::endl;
+
+    std::size_t total_random_games = 100, wins = 0;
+    Game<N> game;
+    for (std::size_t g = 0; g < total_random_games; g++) {
+        unsigned dual_color = g % 2;
+        game.reset();
+        bool running = true;
+        while (running) {
+            if (game.ActivePlayer() == dual_color) {
+                running = game.takeTurn(dual.getChosenMove(game, false).second);
+            } else {
+                running = game.takeTurn(game.randomEmptyCell());
+            }
+        }
+        wins += game.getRank(dual_color) == 0;
+    }
+    std::cout << "policy and value winrate against random: " << double(wins) / total_random_games << " in "
+              << total_random_games << " games" << std::endl;
+}
 
-    if (for_python) {
-        std::cout << game.asciiStatePython() << std::endl;
-        std::cout << "__GAME_OVER__ " << (game.getRank(0) ? 0 : 1) << std::endl;
+
+/******************\
+ *  Convolutions  *
+\******************/
+// Compares the hex convolution kernel of ConvNetworkStrategy with its Shark network on both players'
+// views of the positions of random games and times both, then times the moves of the greedy
+// convolutional player and of the greedy dense TD player. Without a model the weights are random,
+// the dense ones always are. Returns 1 if a value differs by more than float rounding can explain.
+template <unsigned N>
+int reportConvolution(std::string model) {
+    ConvNetworkStrategy<N> conv;
+    TDNetworkStrategy<N> dense;
+    if (model.length() > 0) {
+        conv.loadStrategy(model);
     } else {
-        std::cout << game.asciiState() << std::endl;
-        std::cout << "Game over. Player " << (game.getRank(0) == 0 ? 1 : 2) << " won!" << std::endl;
+        conv.setParameters(RealVector(blas::normal(currentRng(), conv.numParameters(), 0.0, 1.0/(N*N), blas::cpu_tag())));
+    }
+    dense.setParameters(RealVector(blas::normal(currentRng(), dense.numParameters(), 0.0, 1.0/(N*N), blas::cpu_tag())));
+    std::cout << "parameters: " << conv.numParameters() << " convolutional, " << dense.numParameters()
+              << " dense" << std::endl;
+
+    std::vector<std::pair<Game<N>, std::vector<unsigned>>> games = recordRandomGames<N>(100);
+    std::vector<double> values[2];
+    double seconds[2];
+    const Precision precisions[2] = {Precision::Double, Precision::Float32};
+    for (int variant = 0; variant < 2; variant++) {
+        conv.setPrecision(precisions[variant]);
+        auto start_time = std::chrono::steady_clock::now();
+        for (auto& recorded : games) {
+            Game<N> game = recorded.first;
+            for (unsigned move : recorded.second) {
+                values[variant].push_back(conv.evaluate(game.getBoard(), Blue));
+                values[variant].push_back(conv.evaluate(game.getBoard(), Red));
+                game.takeTurn(move);
+            }
+        }
+        seconds[variant] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    double max_error = 0;
+    std::size_t failures = 0;
+    for (std::size_t k = 0; k < values[0].size(); k++) {
+        double error = std::abs(values[1][k] - values[0][k]);
+        max_error = std::max(max_error, error);
+        failures += error > 1e-4;
+    }
+    std::cout << values[0].size() << " positions" << std::endl;
+    std::cout << "Shark:  " << values[0].size() / seconds[0] << " evals/sec" << std::endl;
+    std::cout << "kernel: " << values[1].size() / seconds[1] << " evals/sec, max abs error " << max_error
+              << ", values out of tolerance: " << failures << std::endl;
+
+    for (int variant = 0; variant < 2; variant++) {
+        // the sum of the chosen moves is printed, which also keeps them from being optimized away
+        std::size_t moves = 0, move_sum = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        for (auto& recorded : games) {
+            Game<N> game = recorded.first;
+            for (unsigned move : recorded.second) {
+                move_sum += (variant == 0 ? conv.getChosenMove(game, false) : dense.getChosenMove(game, false)).second;
+                moves++;
+                game.takeTurn(move);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << (variant == 0 ? "greedy convolutional: " : "greedy dense:         ") << moves / seconds
+                  << " moves/sec, move sum " << move_sum << std::endl;
+    }
+    return failures > 0;
+}
+
+
+/****************\
+ *  Records     *
+\****************/
+// Replays every game of a record file for this board size and checks the stored winners
+template <unsigned N>
+void replayRecords(std::string path) {
+    GameRecordReader reader(path);
+    std::size_t games = 0, plies = 0, blue_wins = 0, mismatches = 0, other_sizes = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    Game<N> game;
+    for (GameRecord record : reader) {
+        if (record.header->boardSize != N) {
+            other_sizes++;
+            continue;
+        }
+        game.reset(record.header->firstPlayer);
+        bool running = true;
+        for (unsigned k=0; k < record.header->numMoves && running; k++) {
+            running = game.takeTurn(record.moves[k]);
+        }
+        unsigned winner = (game.getRank(Blue) == 0 ? Blue : Red);
+        mismatches += running || winner != record.header->winner;
+        blue_wins += winner == Blue;
+        plies += record.header->numMoves;
+        games++;
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << games << " " << N << "x" << N << " games (" << plies << " moves) replayed in " << seconds << " s, "
+              << games / seconds << " games/sec" << std::endl;
+    std::cout << "Blue winrate: " << (games ? double(blue_wins) / games : 0.0) << ", winner mismatches: " << mismatches
+              << ", games of other sizes: " << other_sizes << std::endl;
+}
 
+
+/*****************\
+ *  Model files  *
+\*****************/
+// Converts a model, usually a Shark text archive, to the binary format of hex_model.hpp and checks
+// that the binary model loads the same parameters and maps the same inference weights
+template <unsigned N, class StrategyType>
+int convertModel(std::string model, std::string output, bool float_weights) {
+    if (model.length() == 0 || output.length() == 0) {
+        std::cout << "convert needs the model and the binary model to write" << std::endl;
+        return 1;
+    }
+    StrategyType original, converted;
+    auto start_time = std::chrono::steady_clock::now();
+    original.loadStrategy(model);
+    double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    RealVector parameters = original.GetMoveModel().parameterVector();
+    writeModelFile(output, original.layerShapes(), parameters, float_weights);
+
+    start_time = std::chrono::steady_clock::now();
+    converted.loadStrategy(output);
+    double binary_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    RealVector loaded = converted.GetMoveModel().parameterVector();
+    double max_error = 0;
+    for (std::size_t k = 0; k < parameters.size(); k++) {
+        max_error = std::max(max_error, std::abs(loaded(k) - parameters(k)));
+    }
+    // the inference weights the converted model maps, against those of the original
+    float const* copied = original.inference().layout();
+    float const* mapped = converted.inference().layout();
+    std::size_t weight_differences = 0;
+    for (std::size_t k = 0; k < MLPInference::layoutSize(original.layerShapes()); k++) {
+        weight_differences += copied[k] != mapped[k];
+    }
+    ModelFileReader file(output);
+    std::cout << "layers:";
+    for (LayerShape const& shape : file.shapes()) {
+        std::cout << " " << shape.inputs << "x" << shape.outputs;
+    }
+    std::cout << ", " << file.numParameters() << (file.isFloat() ? " float" : " double") << " parameters, "
+              << file.size() << " bytes, checksum " << std::hex << file.checksum() << std::dec << std::endl;
+    std::cout << "loaded in " << load_seconds * 1000 << " ms, binary in " << binary_seconds * 1000 << " ms, "
+              << "largest parameter difference: " << max_error << ", inference weights that differ: "
+              << weight_differences << std::endl;
+    return ((float_weights || max_error == 0) && weight_differences == 0) ? 0 : 1;
 }
 
+// Writes the header of constexpr weights that the hex_play executable is compiled with
+template <unsigned N, class StrategyType>
+int writeModelHeader(std::string model, std::string output) {
+    if (model.length() == 0 || output.length() == 0) {
+        std::cout << "header needs the model and the header to write" << std::endl;
+        return 1;
+    }
+    StrategyType strategy;
+    strategy.loadStrategy(model);
+    writeEmbeddedHeader(output, model, N, strategy.type(), strategy.layerShapes(), strategy.GetMoveModel().parameterVector());
+    return 0;
+}
 
-/**********\
- *  Main  *
-\**********/
-int main (int argc, char* argv[]) {
-    shark::random::globalRng().seed(time(NULL));
 
-    if (argc > 3) {
-        std::cout << "usage: (what: traines/es, traintd/td, esplay, tdplay) (model)" << std::endl;
-        exit(1);
+/*******************\
+ *  Opening books  *
+\*******************/
+// Searches the positions of the first plies in which one player has followed the book so far: that
+// player gets the searched move, the other one every move, for either player following the book.
+// Positions that are the same up to the symmetries of the book are searched once.
+template <unsigned N>
+class OpeningBookBuilder {
+    AlphaBetaStrategy<N>& m_search;
+    unsigned m_plies;
+    std::unordered_map<uint64_t, OpeningBookEntry> m_entries;
+    std::unordered_set<uint64_t> m_expanded;    // positions of the current side of the book
+    double m_seconds = 0;
+
+    // the book move of the position, searched if no symmetric position has been
+    unsigned m_book_move(Game<N>& game, BookPosition<N> const& position) {
+        auto found = m_entries.find(position.key);
+        if (found == m_entries.end()) {
+            std::pair<double, int> chosen = m_search.getChosenMove(game);
+            m_seconds += m_search.lastSearch().seconds;
+            OpeningBookEntry entry;
+            entry.key = position.key;
+            entry.value = float(std::min(std::max(chosen.first, 0.0), 1.0));
+            entry.depth = m_search.lastSearch().depth;
+            entry.move = position.toMove(chosen.second);
+            entry.reserved = 0;
+            found = m_entries.emplace(position.key, entry).first;
+        }
+        return position.toCell(found->second.move);
     }
 
-    std::string what  = (argc >= 2) ? argv[1] : "";
-    std::string model = (argc == 3) ? argv[2] : "";
+    void m_expand(Game<N>& game, unsigned ply, unsigned book_side) {
+        BookPosition<N> position(game.getBoard(), game.ActivePlayer());
+        if (ply >= m_plies || !m_expanded.insert(position.key).second) {
+            return;
+        }
+        uint8_t moves[N*N];
+        unsigned num_moves = 0;
+        if (ply % 2 == book_side) {
+            moves[num_moves++] = m_book_move(game, position);
+        } else {
+            for (unsigned k = 0; k < game.numEmptyCells(); k++) {
+                moves[num_moves++] = game.emptyCell(k);
+            }
+        }
+        for (unsigned k = 0; k < num_moves; k++) {
+            if (!game.makeMove(moves[k])) {
+                m_expand(game, ply + 1, book_side);
+            }
+            game.unmakeMove();
+        }
+    }
 
-    if (what.length() == 0) {
-        std::cout << "what to run? Options are: traines (or es), traintd (or td), esplay, tdplay" << std::endl;
-        getline(std::cin, what);
+public:
+    OpeningBookBuilder(AlphaBetaStrategy<N>& search, unsigned plies) : m_search(search), m_plies(plies) {}
+
+    void build() {
+        for (unsigned book_side = 0; book_side < 2; book_side++) {
+            Game<N> game;
+            game.reset(Blue);
+            m_expanded.clear();
+            m_expand(game, 0, book_side);
+        }
     }
 
-    bool train_td;
+    std::vector<OpeningBookEntry> entries() const {
+        std::vector<OpeningBookEntry> entries;
+        for (auto const& entry : m_entries) {
+            entries.push_back(entry.second);
+        }
+        return entries;
+    }
+
+    // seconds spent searching
+    double seconds() const { return m_seconds; }
+};
+
+// Builds a book of the given plies with the alpha-beta search of a TD model and checks it: in
+// random games with either player following the book, every move of that player within the plies
+// has to be in it.
+template <unsigned N>
+int buildOpeningBook(std::string model, std::string output, unsigned plies, Precision precision,
+                     AlphaBetaOptions const& options) {
+    if (model.length() == 0 || output.length() == 0) {
+        std::cout << "abbook needs the model and the book to write" << std::endl;
+        return 1;
+    }
+    AlphaBetaStrategy<N> search;
+    search.loadStrategy(model);
+    search.setPrecision(precision);
+    search.setOptions(options);
+
+    OpeningBookBuilder<N> builder(search, plies);
+    builder.build();
+    std::vector<OpeningBookEntry> entries = builder.entries();
+    writeOpeningBook(output, N, entries);
+    OpeningBook<N> book(output);
+    std::cout << book.size() << " positions of the first " << plies << " plies searched in " << builder.seconds()
+              << " s, " << builder.seconds() / book.size() * 1000 << " ms per position, "
+              << sizeof(OpeningBookFileHeader) + book.size() * sizeof(OpeningBookEntry) << " bytes" << std::endl;
+
+    std::size_t lookups = 0, missing = 0;
+    double seconds = 0;
+    Game<N> game;
+    for (unsigned g = 0; g < 1000; g++) {
+        unsigned book_side = g % 2;
+        game.reset(Blue);
+        for (unsigned ply = 0; ply < plies; ply++) {
+            unsigned move = game.randomEmptyCell();
+            if (ply % 2 == book_side) {
+                std::pair<double, int> chosen;
+                auto start_time = std::chrono::steady_clock::now();
+                bool found = book.find(game.getBoard(), game.ActivePlayer(), chosen);
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+                lookups++;
+                if (!found) {
+                    missing++;
+                    break;
+                }
+                move = chosen.second;
+            }
+            if (!game.takeTurn(move)) {
+                break;
+            }
+        }
+    }
+    std::cout << lookups << " book moves of random games, " << missing << " missing, "
+              << seconds / lookups * 1e6 << " us per lookup" << std::endl;
+    return missing == 0 ? 0 : 1;
+}
+
+
+/****************\
+ *  Run a size  *
+\****************/
+// command line options besides what to run and the model
+struct RunOptions {
+    std::string record;
+    uint64_t seed;
+    Precision precision = Precision::Float32;
+    std::string output;             // file written by tdconvert, esconvert, dualconvert, tdheader, esheader and abbook
+    bool float_weights = false;     // whether they store the weights as float
+    MCTSOptions mcts;               // search of mctsplay, mctspython and mctsbench
+    AlphaBetaOptions alphabeta;     // search of abplay, abpython, abbench and abbook
+    std::string book;               // opening book of the play modes and of the games of the trainers
+    unsigned book_plies = 4;        // plies of the book written by abbook
+};
+
+template <unsigned N>
+int runHex(std::string what, std::string model, RunOptions const& options) {
+    Precision precision = options.precision;
+    std::unique_ptr<OpeningBook<N>> book;
+    if (options.book.length() > 0) {
+        book.reset(new OpeningBook<N>(options.book));
+    }
+    // the algorithm to train with, "es", "td", "dual" or "conv"
+    std::string training;
     if (boost::iequals(what, "traines") || boost::iequals(what, "es")) {
-        train_td = false;
+        training = "es";
     }
     else if (boost::iequals(what, "traintd") || boost::iequals(what, "td")) {
-        train_td = true;
+        training = "td";
+    }
+    else if (boost::iequals(what, "traindual") || boost::iequals(what, "dual")) {
+        training = "dual";
+    }
+    else if (boost::iequals(what, "trainconv") || boost::iequals(what, "conv")) {
+        training = "conv";
     }
     else if (boost::iequals(what, "esplay")) {
-        playHexCSAVsHuman(model, false);
+        playHexCSAVsHuman<N>(model, false, precision, book.get());
         return 0;
     }
     else if (boost::iequals(what, "espython")) {
-        playHexCSAVsHuman(model, true);
+        playHexCSAVsHuman<N>(model, true, precision, book.get());
         return 0;
     }
     else if (boost::iequals(what, "tdplay")) {
-        playHexTDVsHuman(model, false);
+        playHexTDVsHuman<N>(model, false, precision, book.get());
         return 0;
     }
     else if (boost::iequals(what, "tdpython")) {
-        playHexTDVsHuman(model, true);
+        playHexTDVsHuman<N>(model, true, precision, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "dualplay")) {
+        playHexTDVsHuman<N, DualHeadStrategy<N>>(model, false, precision, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "dualpython")) {
+        playHexTDVsHuman<N, DualHeadStrategy<N>>(model, true, precision, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "dualbench")) {
+        reportDualHead<N>(model, precision);
+        return 0;
+    }
+    else if (boost::iequals(what, "convplay")) {
+        playHexTDVsHuman<N, ConvNetworkStrategy<N>>(model, false, precision, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "convpython")) {
+        playHexTDVsHuman<N, ConvNetworkStrategy<N>>(model, true, precision, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "convbench")) {
+        return reportConvolution<N>(model);
+    }
+    else if (boost::iequals(what, "mctsplay")) {
+        playHexSearchVsHuman<N, MCTSStrategy<N>>(model, false, precision, options.mcts, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "mctspython")) {
+        playHexSearchVsHuman<N, MCTSStrategy<N>>(model, true, precision, options.mcts, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "mctsbench")) {
+        reportMCTS<N>(model, precision, options.mcts);
+        return 0;
+    }
+    else if (boost::iequals(what, "abplay")) {
+        playHexSearchVsHuman<N, AlphaBetaStrategy<N>>(model, false, precision, options.alphabeta, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "abpython")) {
+        playHexSearchVsHuman<N, AlphaBetaStrategy<N>>(model, true, precision, options.alphabeta, book.get());
+        return 0;
+    }
+    else if (boost::iequals(what, "abbench")) {
+        reportAlphaBeta<N>(model, precision, options.alphabeta);
+        return 0;
+    }
+    else if (boost::iequals(what, "abbook")) {
+        return buildOpeningBook<N>(model, options.output, options.book_plies, precision, options.alphabeta);
+    }
+    else if (boost::iequals(what, "bench")) {
+        benchmarkLookahead<N>();
+        return 0;
+    }
+    else if (boost::iequals(what, "benchwin")) {
+        benchmarkWinDetection<N>();
+        return 0;
+    }
+    else if (boost::iequals(what, "benchplayout")) {
+        benchmarkRandomPlayouts<N>();
+        return 0;
+    }
+    else if (boost::iequals(what, "tdparity")) {
+        return checkInferenceParity<N, TDNetworkStrategy<N>>(model);
+    }
+    else if (boost::iequals(what, "esparity")) {
+        return checkInferenceParity<N, CSANetworkStrategy<N>>(model);
+    }
+    else if (boost::iequals(what, "dualparity")) {
+        return checkInferenceParity<N, DualHeadStrategy<N>>(model);
+    }
+    else if (boost::iequals(what, "tdquant")) {
+        reportQuantization<N, TDNetworkStrategy<N>>(model);
+        return 0;
+    }
+    else if (boost::iequals(what, "esquant")) {
+        reportQuantization<N, CSANetworkStrategy<N>>(model);
+        return 0;
+    }
+    else if (boost::iequals(what, "tdconvert")) {
+        return convertModel<N, TDNetworkStrategy<N>>(model, options.output, options.float_weights);
+    }
+    else if (boost::iequals(what, "esconvert")) {
+        return convertModel<N, CSANetworkStrategy<N>>(model, options.output, options.float_weights);
+    }
+    else if (boost::iequals(what, "dualconvert")) {
+        return convertModel<N, DualHeadStrategy<N>>(model, options.output, options.float_weights);
+    }
+    else if (boost::iequals(what, "tdheader")) {
+        return writeModelHeader<N, TDNetworkStrategy<N>>(model, options.output);
+    }
+    else if (boost::iequals(what, "esheader")) {
+        return writeModelHeader<N, CSANetworkStrategy<N>>(model, options.output);
+    }
+    else if (boost::iequals(what, "replay")) {
+        replayRecords<N>(model);
         return 0;
     }
     else {
-        std::cout << "invalid input. Options are: traines (or es), traintd (or td), esplay, tdplay" << std::endl;
+        std::cout << "invalid input. Options are: traines (or es), traintd (or td), traindual (or dual), trainconv (or conv), esplay, tdplay, dualplay, convplay" << std::endl;
         return 1;
     }
 
@@ -549,13 +1684,123 @@ int main (int argc, char* argv[]) {
         model += "_";
     }
 
-    if (train_td) {
+    std::unique_ptr<GameRecordWriter> recorder;
+    if (options.record.length() > 0) {
+        recorder.reset(new GameRecordWriter(options.record, options.seed));
+    }
+
+    if (training == "td") {
         std::cout << "Training model with TD algorithm." << std::endl;
-        trainingLoop<ModelTrainerTD>(model + "TDmodel");
+        trainingLoop<ModelTrainerTD<N>>(model + "TDmodel", recorder.get(), precision, book.get());
+    } else if (training == "conv") {
+        std::cout << "Training convolutional model with TD algorithm." << std::endl;
+        trainingLoop<ModelTrainerTD<N, ConvNetworkStrategy<N>>>(model + "CONVmodel", recorder.get(), precision, book.get());
+    } else if (training == "dual") {
+        std::cout << "Training policy and value model with TD actor-critic." << std::endl;
+        trainingLoop<ModelTrainerDualHead<N>>(model + "DUALmodel", recorder.get(), precision, book.get());
     } else {
         std::cout << "Training model with CSA-ES algorithm." << std::endl;
-        trainingLoop<ModelTrainerCSA>(model + "CSAmodel");
+        trainingLoop<ModelTrainerCSA<N>>(model + "CSAmodel", recorder.get(), precision, book.get());
     }
 
     return 0;
 }
+
+// every board size gets its own instantiation, the command line picks one at runtime
+int runHexWithSize(unsigned board_size, std::string what, std::string model, RunOptions const& options) {
+    switch (board_size) {
+        case 3:  return runHex<3>(what, model, options);
+        case 4:  return runHex<4>(what, model, options);
+        case 5:  return runHex<5>(what, model, options);
+        case 6:  return runHex<6>(what, model, options);
+        case 7:  return runHex<7>(what, model, options);
+        case 8:  return runHex<8>(what, model, options);
+        case 9:  return runHex<9>(what, model, options);
+        case 10: return runHex<10>(what, model, options);
+        case 11: return runHex<11>(what, model, options);
+        case 12: return runHex<12>(what, model, options);
+        case 13: return runHex<13>(what, model, options);
+        default:
+            std::cout << "invalid board size " << board_size << ". Sizes from 3 to 13 are supported." << std::endl;
+            return 1;
+    }
+}
+
+
+/**********\
+ *  Main  *
+\**********/
+int main (int argc, char* argv[]) {
+    std::string usage = "usage: [--size n] [--seed n] [--record file] [--precision double|float|int8] [--float-weights] [--visits n] [--move-time ms] [--threads n] [--depth n] [--book file] [--book-plies n] (what: traines/es, traintd/td, traindual/dual, trainconv/conv, esplay, tdplay, dualplay, dualbench, convplay, convbench, mctsplay, mctsbench, abplay, abbench, abbook, bench, benchwin, benchplayout, tdparity, esparity, dualparity, tdquant, esquant, tdconvert, esconvert, dualconvert, tdheader, esheader, replay) (model or record file) (binary model, header or opening book to write)";
+
+    // option flags, everything else is positional
+    unsigned board_size = 7;
+    RunOptions options;
+    options.seed = time(NULL);
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-s" || arg == "--size" || arg == "--seed" || arg == "--record" || arg == "--precision"
+            || arg == "--visits" || arg == "--move-time" || arg == "--threads" || arg == "--depth"
+            || arg == "--book" || arg == "--book-plies") {
+            if (i + 1 >= argc) {
+                std::cout << usage << std::endl;
+                exit(1);
+            }
+            std::string value = argv[++i];
+            if (arg == "--seed") {
+                options.seed = std::stoull(value);
+            } else if (arg == "--record") {
+                options.record = value;
+            } else if (arg == "--visits") {
+                options.mcts.visits = std::stoul(value);
+            } else if (arg == "--move-time") {
+                options.mcts.milliseconds = std::stoul(value);
+                options.alphabeta.milliseconds = std::stoul(value);
+            } else if (arg == "--depth") {
+                options.alphabeta.max_depth = std::stoul(value);
+            } else if (arg == "--book") {
+                options.book = value;
+            } else if (arg == "--book-plies") {
+                options.book_plies = std::stoul(value);
+            } else if (arg == "--threads") {
+                options.mcts.threads = std::stoul(value);
+            } else if (arg == "--precision") {
+                if (value == "double") {
+                    options.precision = Precision::Double;
+                } else if (value == "float") {
+                    options.precision = Precision::Float32;
+                } else if (value == "int8") {
+                    options.precision = Precision::Int8;
+                } else {
+                    std::cout << usage << std::endl;
+                    exit(1);
+                }
+            } else {
+                board_size = atoi(value.c_str());
+            }
+        } else if (arg == "--float-weights") {
+            options.float_weights = true;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    shark::random::globalRng().seed(options.seed);
+    setRngSeed(options.seed);
+
+    if (args.size() > 3) {
+        std::cout << usage << std::endl;
+        exit(1);
+    }
+
+    std::string what  = (args.size() >= 1) ? args[0] : "";
+    std::string model = (args.size() >= 2) ? args[1] : "";
+    options.output = (args.size() == 3) ? args[2] : "";
+
+    if (what.length() == 0) {
+        std::cout << "what to run? Options are: traines (or es), traintd (or td), traindual (or dual), trainconv (or conv), esplay, tdplay, dualplay, convplay" << std::endl;
+        getline(std::cin, what);
+    }
+
+    return runHexWithSize(board_size, what, model, options);
+}
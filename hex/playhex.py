@@ -25,17 +25,23 @@ def closeHex(hex_process):
     except:
         pass
 
+""" The executable to play against, build/hex_play with --embedded """
+hex_executable = 'build/hex'
+""" Options passed on to it, the opening book with --book """
+hex_options = []
+
 """ Start the hex process """
-def startHex(model="", what=""):
-    hex_process = subprocess.Popen(['build/hex', what, model], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+def startHex(model="", what="", size=7):
+    hex_process = subprocess.Popen([hex_executable, '--size', str(size)] + hex_options + [what, model], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
     atexit.register(lambda: closeHex(hex_process))
     return hex_process
 
 """ The interface between the hex subprocess and the main process. """
 class HexInterface():
-    def __init__(self, model="", what=""):
+    def __init__(self, model="", what="", size=7):
         self.model = model
         self.what = what
+        self.size = size
         self.startHexSafe()
         self.board_size = 0
         self.recent_board = ""
@@ -44,7 +50,7 @@ class HexInterface():
         self.player_won = -1
 
     def startHexSafe(self):
-        self.hex_process = startHex(self.model, self.what)
+        self.hex_process = startHex(self.model, self.what, self.size)
         rlist, wlist, xlist = select.select([self.hex_process.stdout], [], [])
         while True:
             output = ""
@@ -58,7 +64,7 @@ class HexInterface():
                 elif line == "__MODEL_BAD__":
                     self.model = ""
                     messagebox.showerror("Model error", "The model could not be loaded. Are the dimensions correct?")
-                    self.hex_process = startHex()
+                    self.hex_process = startHex("", self.what, self.size)
                     rlist, wlist, xlist = select.select([], [self.hex_process.stdin], [])
                     os.write(wlist[0].fileno(), '__BEGIN__\n'.encode(sys.stdin.encoding))
                     return
@@ -143,11 +149,11 @@ class HexGUI(tk.Canvas):
 
 """ The tk application """
 class HexApp(tk.Frame):
-    def __init__(self, master=None, model="", what=""):
+    def __init__(self, master=None, model="", what="", size=7):
         tk.Frame.__init__(self, master)
         self.grid(padx=5, pady=5)
 
-        self.hex_interface = HexInterface(model, what)
+        self.hex_interface = HexInterface(model, what, size)
         self.hex_interface.readOutput()
 
         self.createWidgets()
@@ -214,12 +220,12 @@ class HexApp(tk.Frame):
             self.reset()
             self.updateModelStringvar()
 
-def main(model, algorithm):
+def main(model, algorithm, size):
     root = tk.Tk()
-    if algorithm.upper() != "TD" and algorithm.upper() != "ES":
-        sys.exit("Algorithm must be TD or ES.")
+    if algorithm.upper() not in ("TD", "ES", "DUAL", "CONV", "MCTS", "AB"):
+        sys.exit("Algorithm must be TD, ES, DUAL, CONV, MCTS or AB.")
     algorithm += "python"
-    app = HexApp(root, model, algorithm)
+    app = HexApp(root, model, algorithm, size)
     app.master.title("Hex")
     app.mainloop()
 
@@ -227,11 +233,20 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Play hex.")
     parser.add_argument("--model", dest="model", default="")
     parser.add_argument("--make", dest="make", action='store_true')
-    parser.add_argument("--algorithm", dest="algorithm", required=True, help="es/td")
+    parser.add_argument("--algorithm", dest="algorithm", required=True, help="es/td/dual/conv/mcts/ab")
+    parser.add_argument("--size", dest="size", type=int, default=7, help="board size (3-13)")
+    parser.add_argument("--embedded", dest="embedded", action='store_true', help="play the model built into build/hex_play")
+    parser.add_argument("--book", dest="book", default="", help="opening book written by hex abbook")
     args = parser.parse_args()
 
+    target = "hex_python"
+    if args.embedded:
+        hex_executable = 'build/hex_play'
+        target = "hex_play"
+    if args.book:
+        hex_options = ['--book', args.book]
     if args.make:
-        if subprocess.run(["cd build && make hex_python && cd .."], shell=True).returncode != 0:
+        if subprocess.run(["cd build && make " + target + " && cd .."], shell=True).returncode != 0:
             sys.exit("Failed to make.")
 
-    main(args.model, args.algorithm)
+    main(args.model, args.algorithm, args.size)